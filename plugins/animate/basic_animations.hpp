@@ -12,7 +12,7 @@ class fade_animation : public animation_base
 
     float start = 0, end = 1;
     wf_duration duration;
-    std::string name;
+    uint32_t name_id;
 
     public:
 
@@ -25,15 +25,15 @@ class fade_animation : public animation_base
         if (close)
             std::swap(start, end);
 
-        name = "animation-fade-" + std::to_string(close);
-        view->add_transformer(nonstd::make_unique<wf_2D_view> (view), name);
+        name_id = wf_get_name_id("animation-fade-" + std::to_string(close));
+        view->add_transformer(nonstd::make_unique<wf_2D_view> (view), name_id);
     }
 
     bool step()
     {
         log_info("duration has progress %f", duration.progress_percentage());
 
-        auto transform = dynamic_cast<wf_2D_view*> (view->get_transformer(name).get());
+        auto transform = static_cast<wf_2D_view*> (view->get_transformer(name_id).get());
         transform->alpha = duration.progress(start, end);
         return duration.running();
     }
@@ -41,7 +41,7 @@ class fade_animation : public animation_base
     ~fade_animation()
     {
         view->alpha = 1.0f;
-        view->pop_transformer(name);
+        view->pop_transformer(name_id);
     }
 };
 
@@ -76,8 +76,7 @@ class zoom_animation : public animation_base
     {
         float c = duration.progress(zoom_start, zoom_end);
         our_transform->alpha = duration.progress(alpha_start, alpha_end);
-        our_transform->scale_x = c;
-        our_transform->scale_y = c;
+        our_transform->set_scale(c, c);
 
         return duration.running();
     }
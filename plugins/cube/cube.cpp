@@ -452,8 +452,7 @@ class wayfire_cube : public wayfire_plugin_t
         {
             if (streams[i]->fbuff != uint32_t(-1))
             {
-                GL_CALL(glDeleteFramebuffers(1, &streams[i]->fbuff));
-                GL_CALL(glDeleteTextures(1, &streams[i]->tex));
+                OpenGL::release_render_target(streams[i]->fbuff, streams[i]->tex);
             }
         }
 
@@ -21,47 +21,14 @@ extern "C"
 #include <view-transform.hpp>
 #include <signal-definitions.hpp>
 #include "deco-subsurface.hpp"
+#include "glyph-atlas.hpp"
 
 #include <cairo.h>
 
 const int titlebar_thickness = 30;
 const int resize_edge_threshold = 5;
 const int normal_thickness = resize_edge_threshold;
-
-GLuint get_text_texture(int width, int height, std::string text)
-{
-    const auto format = CAIRO_FORMAT_ARGB32;
-    auto surface = cairo_image_surface_create(format, width, height);
-    auto cr = cairo_create(surface);
-
-    const float font_scale = 0.8;
-    const float font_size = height * font_scale;
-
-    // render text
-    cairo_select_font_face(cr, "serif", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
-    cairo_set_source_rgba(cr, 1, 1, 1, 1);
-
-    cairo_set_font_size(cr, font_size);
-
-    cairo_text_extents_t ext;
-    cairo_text_extents(cr, text.c_str(), &ext);
-
-    cairo_move_to(cr, normal_thickness, font_size);
-    cairo_show_text(cr, text.c_str());
-
-    cairo_destroy(cr);
-
-    auto src = cairo_image_surface_get_data(surface);
-
-    GLuint tex;
-    GL_CALL(glGenTextures(1, &tex));
-    GL_CALL(glBindTexture(GL_TEXTURE_2D, tex));
-    GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, src));
-
-    cairo_surface_destroy(surface);
-
-    return tex;
-}
+const float font_scale = 0.8;
 
 class simple_decoration_surface : public wayfire_compositor_surface_t, public wf_decorator_frame_t
 {
@@ -91,8 +58,13 @@ class simple_decoration_surface : public wayfire_compositor_surface_t, public wf
             title_set = [=] (signal_data *data)
             {
                 if (get_signaled_view(data) == view)
-                    notify_view_resized(view->get_wm_geometry());
+                {
+                    title.set_text(view->get_title());
+                    view->damage();
+                }
             };
+
+            title.set_text(view->get_title());
         }
 
         virtual void set_output(wayfire_output *next_output)
@@ -127,12 +99,14 @@ class simple_decoration_surface : public wayfire_compositor_surface_t, public wf
         float border_color[4] = {0.15f, 0.15f, 0.15f, 0.8f};
         float border_color_inactive[4] = {0.25f, 0.25f, 0.25f, 0.95f};
 
-        GLuint tex = -1;
+        /* glyphs are shared between all decorations on the output,
+         * each decoration keeps only the quads for its title */
+        wf_text_line title;
 
         virtual void _wlr_render_box(const wlr_fb_attribs& fb, int x, int y, const wlr_box& scissor)
         {
             wlr_box geometry {x, y, width, height};
-            geometry = get_output_box_from_box(geometry, output->handle->scale);
+            geometry = get_output_box_from_box(geometry, output->handle->scale * fb.zoom);
 
             float projection[9];
             wlr_matrix_projection(projection, fb.width, fb.height, fb.transform);
@@ -145,26 +119,27 @@ class simple_decoration_surface : public wayfire_compositor_surface_t, public wf
 
             wlr_render_quad_with_matrix(core->renderer, active ? border_color : border_color_inactive, matrix);
 
-            if (tex == (uint)-1)
-                tex = get_text_texture(geometry.width, titlebar, view->get_title());
-
-            auto ortho = glm::ortho(0.0f, 1.0f * fb.width, 1.0f * fb.height, 0.0f);
-
-            gl_geometry gg;
-            gg.x1 = geometry.x;
-            gg.y1 = geometry.y;
-            gg.x2 = geometry.x + geometry.width;
-            gg.y2 = geometry.y + titlebar;
-
-            OpenGL::use_default_program();
-            OpenGL::render_transformed_texture(tex, gg, {}, ortho, {1, 1, 1, 1}, TEXTURE_TRANSFORM_INVERT_Y);
+            if (titlebar > 0)
+            {
+                const float scale = output->handle->scale;
+                title.set_atlas(wf_glyph_atlas::get(output, titlebar * scale * font_scale));
+                title.set_max_width((width - 2 * thickness) * scale);
+
+                /* the title is laid out at the output scale and only
+                 * magnified when zoomed, so we don't rasterize glyphs
+                 * for each zoom level */
+                auto projection = glm::ortho(0.0f, 1.0f * fb.width, 1.0f * fb.height, 0.0f);
+                projection = glm::translate(projection, {1.0f * geometry.x, 1.0f * geometry.y, 0});
+                projection = glm::scale(projection, {fb.zoom, fb.zoom, 1});
+                title.render(normal_thickness * scale, 0, projection, {1, 1, 1, 1});
+            }
 
             wlr_renderer_end(core->renderer);
         }
 
         virtual void _render_pixman(const wlr_fb_attribs& fb, int x, int y, pixman_region32_t* damage)
         {
-            const float scale = output->handle->scale;
+            const float scale = output->handle->scale * fb.zoom;
 
             pixman_region32_t frame_region;
             pixman_region32_init(&frame_region);
@@ -194,6 +169,7 @@ class simple_decoration_surface : public wayfire_compositor_surface_t, public wf
             attribs.width = output->handle->width;
             attribs.height = output->handle->height;
             attribs.transform = output->handle->transform;
+            attribs.zoom = fb.zoom;
 
             render_pixman(attribs, obox.x - fb.geometry.x, obox.y - fb.geometry.y, damage);
         }
@@ -320,10 +296,6 @@ class simple_decoration_surface : public wayfire_compositor_surface_t, public wf
 
         virtual void notify_view_resized(wf_geometry view_geometry)
         {
-            if (tex != (uint32_t)-1)
-                GL_CALL(glDeleteTextures(1, &tex));
-            tex = -1;
-
             width = view_geometry.width;
             height = view_geometry.height;
 
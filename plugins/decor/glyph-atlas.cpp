@@ -0,0 +1,248 @@
+#include <cmath>
+#include <map>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <debug.hpp>
+#include "glyph-atlas.hpp"
+
+/* transparent border around each glyph, so that linear filtering doesn't
+ * pick up pixels from the neighbouring glyphs */
+static const int glyph_padding = 1;
+
+wf_glyph_atlas::wf_glyph_atlas(float font_size)
+{
+    this->font_size = font_size;
+
+    auto surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
+    auto cr = cairo_create(surface);
+
+    cairo_select_font_face(cr, "serif", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+    cairo_set_font_size(cr, font_size);
+    font = cairo_scaled_font_reference(cairo_get_scaled_font(cr));
+
+    cairo_destroy(cr);
+    cairo_surface_destroy(surface);
+
+    GL_CALL(glGenTextures(1, &tex));
+    GL_CALL(glBindTexture(GL_TEXTURE_2D, tex));
+    GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, atlas_size, atlas_size,
+                         0, GL_RGBA, GL_UNSIGNED_BYTE, NULL));
+
+    GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+    GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+    GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+}
+
+wf_glyph_atlas::~wf_glyph_atlas()
+{
+    GL_CALL(glDeleteTextures(1, &tex));
+    cairo_scaled_font_destroy(font);
+}
+
+void wf_glyph_atlas::clear()
+{
+    log_info("glyph atlas for font size %f is full, clearing", font_size);
+
+    glyphs.clear();
+    shelf_x = shelf_y = shelf_height = 0;
+    ++generation;
+}
+
+const wf_glyph_atlas::glyph_t* wf_glyph_atlas::get_glyph(unsigned long index)
+{
+    auto it = glyphs.find(index);
+    if (it != glyphs.end())
+        return &it->second;
+
+    cairo_glyph_t cglyph = {index, 0, 0};
+    cairo_text_extents_t ext;
+    cairo_scaled_font_glyph_extents(font, &cglyph, 1, &ext);
+
+    glyph_t& glyph = glyphs[index];
+
+    /* whitespace, nothing to render */
+    if (ext.width <= 0 || ext.height <= 0)
+    {
+        glyph = {0, 0, 0, 0, 0, 0};
+        return &glyph;
+    }
+
+    int left = std::floor(ext.x_bearing), top = std::floor(ext.y_bearing);
+    int right = std::ceil(ext.x_bearing + ext.width);
+    int bottom = std::ceil(ext.y_bearing + ext.height);
+
+    int width = right - left + 2 * glyph_padding;
+    int height = bottom - top + 2 * glyph_padding;
+
+    /* simple shelf packing, glyphs of the same font have similar heights */
+    if (shelf_x + width > atlas_size)
+    {
+        shelf_x = 0;
+        shelf_y += shelf_height;
+        shelf_height = 0;
+    }
+
+    if (width > atlas_size || shelf_y + height > atlas_size)
+    {
+        clear();
+        return nullptr;
+    }
+
+    glyph.x = shelf_x;
+    glyph.y = shelf_y;
+    glyph.width = width;
+    glyph.height = height;
+    glyph.offset_x = left - glyph_padding;
+    glyph.offset_y = top - glyph_padding;
+
+    shelf_x += width;
+    shelf_height = std::max(shelf_height, height);
+
+    /* white, premultiplied glyph, so the byte order doesn't matter */
+    auto surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+    auto cr = cairo_create(surface);
+
+    cairo_set_scaled_font(cr, font);
+    cairo_set_source_rgba(cr, 1, 1, 1, 1);
+    cglyph.x = -glyph.offset_x;
+    cglyph.y = -glyph.offset_y;
+    cairo_show_glyphs(cr, &cglyph, 1);
+
+    cairo_destroy(cr);
+    cairo_surface_flush(surface);
+
+    GL_CALL(glBindTexture(GL_TEXTURE_2D, tex));
+    GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+    GL_CALL(glTexSubImage2D(GL_TEXTURE_2D, 0, glyph.x, glyph.y, width, height,
+                            GL_RGBA, GL_UNSIGNED_BYTE,
+                            cairo_image_surface_get_data(surface)));
+
+    cairo_surface_destroy(surface);
+    return &glyph;
+}
+
+std::shared_ptr<wf_glyph_atlas> wf_glyph_atlas::get(wayfire_output *output, float font_size)
+{
+    static std::map<std::pair<wayfire_output*, float>, std::weak_ptr<wf_glyph_atlas>> atlases;
+
+    /* drop atlases nobody uses anymore */
+    for (auto it = atlases.begin(); it != atlases.end(); )
+    {
+        if (it->second.expired())
+            it = atlases.erase(it);
+        else
+            ++it;
+    }
+
+    auto& entry = atlases[{output, font_size}];
+    auto atlas = entry.lock();
+    if (!atlas)
+    {
+        atlas = std::make_shared<wf_glyph_atlas> (font_size);
+        entry = atlas;
+    }
+
+    return atlas;
+}
+
+void wf_text_line::set_atlas(std::shared_ptr<wf_glyph_atlas> atlas)
+{
+    if (this->atlas == atlas)
+        return;
+
+    this->atlas = atlas;
+    dirty = true;
+}
+
+void wf_text_line::set_text(const std::string& text)
+{
+    if (this->text == text)
+        return;
+
+    this->text = text;
+    dirty = true;
+}
+
+void wf_text_line::set_max_width(int width)
+{
+    if (max_width == width)
+        return;
+
+    max_width = width;
+    dirty = true;
+}
+
+void wf_text_line::layout()
+{
+    /* if the atlas gets full in the middle of the layout, it is cleared and
+     * we have to start over. The second attempt uses an empty atlas,
+     * so it can fail only if a single line doesn't fit in the atlas */
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        vertices.clear();
+        uv.clear();
+        quad_count = 0;
+
+        cairo_glyph_t *glyphs = NULL;
+        int num_glyphs = 0;
+
+        auto status = cairo_scaled_font_text_to_glyphs(atlas->get_font(),
+            0, atlas->get_font_size(), text.c_str(), text.size(),
+            &glyphs, &num_glyphs, NULL, NULL, NULL);
+
+        if (status != CAIRO_STATUS_SUCCESS)
+            break;
+
+        const float size = atlas->get_size();
+        bool restart = false;
+
+        for (int i = 0; i < num_glyphs; i++)
+        {
+            if (glyphs[i].x >= max_width)
+                break;
+
+            auto glyph = atlas->get_glyph(glyphs[i].index);
+            if (!glyph)
+            {
+                restart = true;
+                break;
+            }
+
+            if (!glyph->width)
+                continue;
+
+            float x1 = std::round(glyphs[i].x) + glyph->offset_x;
+            float y1 = std::round(glyphs[i].y) + glyph->offset_y;
+            float x2 = x1 + glyph->width, y2 = y1 + glyph->height;
+
+            float u1 = glyph->x / size, v1 = glyph->y / size;
+            float u2 = (glyph->x + glyph->width) / size;
+            float v2 = (glyph->y + glyph->height) / size;
+
+            vertices.insert(vertices.end(), {x1, y1, x2, y1, x2, y2, x1, y1, x2, y2, x1, y2});
+            uv.insert(uv.end(), {u1, v1, u2, v1, u2, v2, u1, v1, u2, v2, u1, v2});
+            ++quad_count;
+        }
+
+        cairo_glyph_free(glyphs);
+        if (!restart)
+            break;
+    }
+
+    atlas_generation = atlas->get_generation();
+    dirty = false;
+}
+
+void wf_text_line::render(float x, float y, const glm::mat4& projection, glm::vec4 color)
+{
+    if (!atlas)
+        return;
+
+    if (dirty || atlas_generation != atlas->get_generation())
+        layout();
+
+    auto transform = glm::translate(projection, {x, y, 0});
+    OpenGL::render_textured_quads(atlas->get_texture(), vertices.data(), uv.data(),
+                                  quad_count, transform, color);
+}
@@ -0,0 +1,87 @@
+#ifndef GLYPH_ATLAS_HPP
+#define GLYPH_ATLAS_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cairo.h>
+#include <opengl.hpp>
+
+class wayfire_output;
+
+/* A single texture holding all glyphs rendered so far at a given font size.
+ * Glyphs are rasterized (by cairo, and thus FreeType) only the first time
+ * they are needed. When the atlas is full, it is cleared and its generation
+ * is increased, so that users know they have to lay out their text again */
+class wf_glyph_atlas
+{
+    public:
+    struct glyph_t
+    {
+        /* position in the atlas, in pixels */
+        int x, y, width, height;
+        /* offset of the top-left corner of the glyph from the pen position */
+        float offset_x, offset_y;
+    };
+
+    wf_glyph_atlas(float font_size);
+    ~wf_glyph_atlas();
+
+    float get_font_size() { return font_size; }
+    uint32_t get_generation() { return generation; }
+
+    GLuint get_texture() { return tex; }
+    int get_size() { return atlas_size; }
+
+    cairo_scaled_font_t *get_font() { return font; }
+
+    /* returns the glyph, rasterizing it if necessary. Returns nullptr if the
+     * atlas had to be cleared, in which case layout should be restarted */
+    const glyph_t* get_glyph(unsigned long index);
+
+    /* the atlas shared by all decorations on the output with this font size */
+    static std::shared_ptr<wf_glyph_atlas> get(wayfire_output *output, float font_size);
+
+    private:
+    const int atlas_size = 1024;
+
+    float font_size;
+    uint32_t generation = 0;
+
+    GLuint tex = -1;
+    cairo_scaled_font_t *font = nullptr;
+
+    std::unordered_map<unsigned long, glyph_t> glyphs;
+    int shelf_x = 0, shelf_y = 0, shelf_height = 0;
+
+    void clear();
+};
+
+/* A line of text laid out with a glyph atlas, ready to be drawn in one call */
+class wf_text_line
+{
+    std::shared_ptr<wf_glyph_atlas> atlas;
+    uint32_t atlas_generation = -1;
+
+    std::string text;
+    int max_width = 0;
+    bool dirty = true;
+
+    std::vector<GLfloat> vertices, uv;
+    int quad_count = 0;
+
+    void layout();
+
+    public:
+    void set_atlas(std::shared_ptr<wf_glyph_atlas> atlas);
+    void set_text(const std::string& text);
+    /* glyphs which start after max_width are dropped */
+    void set_max_width(int width);
+
+    /* x, y is the top-left corner of the line box, in the coordinates
+     * of the projection */
+    void render(float x, float y, const glm::mat4& projection, glm::vec4 color);
+};
+
+#endif /* end of include guard: GLYPH_ATLAS_HPP */
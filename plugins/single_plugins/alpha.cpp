@@ -35,6 +35,8 @@ class wayfire_alpha : public wayfire_plugin_t
     axis_callback axis_cb;
     wf_option modifier, min_value;
 
+    const uint32_t transformer_id = wf_get_name_id("alpha");
+
     public:
     void init(wayfire_config *config)
     {
@@ -75,10 +77,10 @@ class wayfire_alpha : public wayfire_plugin_t
         wf_2D_view *transformer;
         float alpha;
 
-        if (!view->get_transformer("alpha"))
-            view->add_transformer(nonstd::make_unique<wf_2D_view> (view), "alpha");
+        if (!view->get_transformer(transformer_id))
+            view->add_transformer(nonstd::make_unique<wf_2D_view> (view), transformer_id);
 
-        transformer = dynamic_cast<wf_2D_view*> (view->get_transformer("alpha").get());
+        transformer = static_cast<wf_2D_view*> (view->get_transformer(transformer_id).get());
         alpha = transformer->alpha;
 
         alpha -= delta * 0.003;
@@ -87,7 +89,7 @@ class wayfire_alpha : public wayfire_plugin_t
             alpha = 1.0;
 
         if (alpha == 1.0)
-            return view->pop_transformer("alpha");
+            return view->pop_transformer(transformer_id);
 
         if (alpha < min_value->as_double())
             alpha = min_value->as_double();
@@ -101,10 +103,10 @@ class wayfire_alpha : public wayfire_plugin_t
 
     void fini()
     {
-        output->workspace->for_each_view([] (wayfire_view view)
+        output->workspace->for_each_view([=] (wayfire_view view)
         {
-            if (view->get_transformer("alpha"))
-                view->pop_transformer("alpha");
+            if (view->get_transformer(transformer_id))
+                view->pop_transformer(transformer_id);
         }, WF_ALL_LAYERS);
 
         output->rem_axis(&axis_cb);
@@ -1,67 +1,539 @@
 #include <output.hpp>
 #include <core.hpp>
+#include <debug.hpp>
 #include <workspace-manager.hpp>
 #include <signal-definitions.hpp>
 #include <view.hpp>
+#include <map>
 #include <set>
-#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
 
-using function = std::function<void()>;
-void idle_callback(void *data)
-{
-    (*(function*)(data))();
-}
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
-class wayfire_apps_logger : public wayfire_plugin_t
+/* Serves the state of the toplevel views on a Unix socket, by default
+ * $XDG_RUNTIME_DIR/wayfire-$WAYLAND_DISPLAY-views, see [apps-logger] socket.
+ *
+ * A client first sends one byte with the format it wants, 'j' for JSON or
+ * 'b' for binary. It then receives the state of every view, an end of
+ * snapshot event, and after that an event each time a view changes or goes
+ * away. Each event carries the full state of the view.
+ *
+ * JSON events are one object per line:
+ *   {"event":"view","id":3,"app_id":"...","title":"...","output":1,
+ *    "workspace":[0,0],"geometry":[x,y,w,h],"focused":false}
+ *   {"event":"removed","id":3}
+ *   {"event":"snapshot-done"}
+ *
+ * Binary events are frames in native byte order: uint32 size of the rest of
+ * the frame, uint8 type (1 view, 2 removed, 3 snapshot done), and for the
+ * first two a uint32 view id. A view event continues with int32 output,
+ * workspace x and y, geometry x, y, width and height, uint8 focused, and
+ * app_id and title, each as a uint16 length followed by the bytes.
+ *
+ * We only keep a small amount of serialized events per client. If a client
+ * doesn't keep up, we just remember which views have changed, and send their
+ * state as it is when the client is ready again, so a slow client gets fewer
+ * events instead of making us buffer without limit */
+class wf_view_feed
 {
-    signal_callback_t created_cb, destroyed_cb;
-    using app = std::pair<std::string, std::string>;
-    wl_event_source *created_idle = NULL, *destroyed_idle = NULL;
+    enum format
+    {
+        FORMAT_NONE   = 0,
+        FORMAT_JSON   = 1,
+        FORMAT_BINARY = 2
+    };
+
+    enum event_type
+    {
+        EVENT_VIEW          = 1,
+        EVENT_REMOVED       = 2,
+        EVENT_SNAPSHOT_DONE = 3
+    };
+
+    struct client
+    {
+        int fd;
+        wl_event_source *source;
+        format fmt = FORMAT_NONE;
+
+        /* serialized events not yet written */
+        std::string out;
+        /* views whose state has to be sent */
+        std::set<uint32_t> dirty;
+        bool snapshot_pending = false;
+    };
+
+    /* don't serialize more if this much is still unread */
+    static const size_t max_buffered = 64 * 1024;
+
+    int listen_fd = -1;
+    std::string socket_path;
+    wl_event_source *listen_source = NULL, *flush_source = NULL;
+
+    std::map<int, client*> clients;
+    std::map<uint32_t, wayfire_view> views;
+    /* view ids start at 0, so -1 means that no view is focused */
+    static const uint32_t no_view = -1;
+    uint32_t focused_id = no_view;
+
+    static int handle_connection(int fd, uint32_t mask, void *data)
+    {
+        ((wf_view_feed*) data)->accept_client();
+        return 0;
+    }
+
+    static int handle_client(int fd, uint32_t mask, void *data)
+    {
+        auto feed = (wf_view_feed*) data;
+        auto it = feed->clients.find(fd);
+        if (it != feed->clients.end())
+            feed->client_event(it->second, mask);
+
+        return 0;
+    }
 
-    void update_log_file()
+    static void handle_flush(void *data)
     {
-        std::ofstream out("/tmp/wayfire-app-list-" + std::to_string(output->id),
-                          std::ofstream::trunc | std::ofstream::out);
+        auto feed = (wf_view_feed*) data;
+        feed->flush_source = NULL;
+
+        /* clients might disconnect while we write to them */
+        std::vector<int> fds;
+        for (auto& c : feed->clients)
+            fds.push_back(c.first);
 
-        size_t id = 1;
-        output->workspace->for_each_view([&out, &id] (wayfire_view view)
+        for (auto fd : fds)
         {
-            if (view->is_mapped())
-            out << "no. " << id << " app_id: " << view->get_app_id() << " title: " << view->get_title() << std::endl;
-            ++id;
-        }, WF_LAYER_WORKSPACE);
+            auto it = feed->clients.find(fd);
+            if (it != feed->clients.end())
+                feed->flush_client(it->second);
+        }
+    }
+
+    void accept_client()
+    {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        auto c = new client;
+        c->fd = fd;
+        c->source = wl_event_loop_add_fd(core->ev_loop, fd, WL_EVENT_READABLE,
+                                         handle_client, this);
+        clients[fd] = c;
+    }
+
+    void disconnect_client(client *c)
+    {
+        wl_event_source_remove(c->source);
+        close(c->fd);
+        clients.erase(c->fd);
+        delete c;
+    }
+
+    void client_event(client *c, uint32_t mask)
+    {
+        if (mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR))
+            return disconnect_client(c);
+
+        if (mask & WL_EVENT_READABLE)
+        {
+            char buf[64];
+            ssize_t len = read(c->fd, buf, sizeof(buf));
+            if (len == 0 || (len < 0 && errno != EAGAIN && errno != EINTR))
+                return disconnect_client(c);
+
+            /* everything after the format is ignored */
+            if (len > 0 && c->fmt == FORMAT_NONE)
+            {
+                if (buf[0] == 'j')
+                    c->fmt = FORMAT_JSON;
+                else if (buf[0] == 'b')
+                    c->fmt = FORMAT_BINARY;
+                else
+                    return disconnect_client(c);
+
+                for (auto& v : views)
+                    c->dirty.insert(v.first);
+                c->snapshot_pending = true;
+            }
+        }
+
+        flush_client(c);
+    }
+
+    void flush_client(client *c)
+    {
+        if (c->fmt == FORMAT_NONE)
+            return;
+
+        /* write, serialize more, write again, until the client is up to
+         * date or its socket is full */
+        while (true)
+        {
+            while (c->out.size() < max_buffered && c->dirty.size())
+            {
+                auto id = *c->dirty.begin();
+                c->dirty.erase(c->dirty.begin());
+
+                auto it = views.find(id);
+                if (it == views.end())
+                    serialize_removed(c, id);
+                else
+                    serialize_view(c, it->second);
+            }
+
+            if (c->dirty.empty() && c->snapshot_pending)
+            {
+                serialize_snapshot_done(c);
+                c->snapshot_pending = false;
+            }
+
+            if (c->out.empty())
+                break;
+
+            ssize_t written = send(c->fd, c->out.data(), c->out.size(),
+                                   MSG_NOSIGNAL | MSG_DONTWAIT);
+
+            if (written < 0 && errno != EAGAIN && errno != EINTR)
+                return disconnect_client(c);
+
+            if (written <= 0)
+                break;
+
+            c->out.erase(0, written);
+        }
+
+        /* wait until the client has read something */
+        uint32_t mask = WL_EVENT_READABLE;
+        if (c->out.size())
+            mask |= WL_EVENT_WRITABLE;
+        wl_event_source_fd_update(c->source, mask);
+    }
+
+    template<class T> static void append(std::string& out, T value)
+    {
+        out.append((const char*) &value, sizeof(value));
+    }
+
+    static void append_string(std::string& out, const std::string& str)
+    {
+        uint16_t len = std::min(str.size(), (size_t)UINT16_MAX);
+        append(out, len);
+        out.append(str, 0, len);
+    }
+
+    static std::string json_string(const std::string& str)
+    {
+        std::string result = "\"";
+        for (unsigned char c : str)
+        {
+            if (c == '"' || c == '\\')
+            {
+                result += '\\';
+                result += c;
+            } else if (c < 0x20)
+            {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                result += buf;
+            } else
+            {
+                result += c;
+            }
+        }
+
+        return result + "\"";
+    }
+
+    /* the binary frame header, the size is filled in by end_frame() */
+    static size_t begin_frame(std::string& out, event_type type)
+    {
+        size_t start = out.size();
+        append(out, uint32_t(0));
+        append(out, uint8_t(type));
+        return start;
+    }
+
+    static void end_frame(std::string& out, size_t start)
+    {
+        uint32_t size = out.size() - start - sizeof(uint32_t);
+        std::memcpy(&out[start], &size, sizeof(size));
+    }
+
+    void serialize_view(client *c, wayfire_view view)
+    {
+        auto output = view->get_output();
+        auto wm = view->get_wm_geometry();
+        auto og = output->get_relative_geometry();
+        GetTuple(vx, vy, output->workspace->get_current_workspace());
+
+        /* the workspace the center of the view is on */
+        int ws_x = vx + std::floor((wm.x + wm.width / 2.0) / og.width);
+        int ws_y = vy + std::floor((wm.y + wm.height / 2.0) / og.height);
+        bool focused = view->get_id() == focused_id;
+
+        if (c->fmt == FORMAT_JSON)
+        {
+            c->out += "{\"event\":\"view\",\"id\":" + std::to_string(view->get_id()) +
+                ",\"app_id\":" + json_string(view->get_app_id()) +
+                ",\"title\":" + json_string(view->get_title()) +
+                ",\"output\":" + std::to_string(output->id) +
+                ",\"workspace\":[" + std::to_string(ws_x) + "," + std::to_string(ws_y) + "]" +
+                ",\"geometry\":[" + std::to_string(wm.x) + "," + std::to_string(wm.y) + "," +
+                std::to_string(wm.width) + "," + std::to_string(wm.height) + "]" +
+                ",\"focused\":" + (focused ? "true" : "false") + "}\n";
+        } else
+        {
+            auto start = begin_frame(c->out, EVENT_VIEW);
+            append(c->out, uint32_t(view->get_id()));
+            for (int32_t value : {output->id, ws_x, ws_y, wm.x, wm.y, wm.width, wm.height})
+                append(c->out, value);
+            append(c->out, uint8_t(focused));
+            append_string(c->out, view->get_app_id());
+            append_string(c->out, view->get_title());
+            end_frame(c->out, start);
+        }
+    }
+
+    void serialize_removed(client *c, uint32_t id)
+    {
+        if (c->fmt == FORMAT_JSON)
+        {
+            c->out += "{\"event\":\"removed\",\"id\":" + std::to_string(id) + "}\n";
+        } else
+        {
+            auto start = begin_frame(c->out, EVENT_REMOVED);
+            append(c->out, id);
+            end_frame(c->out, start);
+        }
+    }
+
+    void serialize_snapshot_done(client *c)
+    {
+        if (c->fmt == FORMAT_JSON)
+        {
+            c->out += "{\"event\":\"snapshot-done\"}\n";
+        } else
+        {
+            auto start = begin_frame(c->out, EVENT_SNAPSHOT_DONE);
+            end_frame(c->out, start);
+        }
+    }
+
+    public:
+    int refcount = 0;
+
+    void start(std::string path)
+    {
+        if (path.empty())
+        {
+            const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+            path = std::string(runtime_dir ? runtime_dir : "/tmp") +
+                "/wayfire-" + core->wayland_display + "-views";
+        }
+
+        sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+
+        if (path.size() >= sizeof(addr.sun_path))
+        {
+            log_error("view feed socket path is too long: %s", path.c_str());
+            return;
+        }
+
+        std::strcpy(addr.sun_path, path.c_str());
+
+        listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        unlink(path.c_str());
+
+        if (listen_fd < 0 || bind(listen_fd, (sockaddr*) &addr, sizeof(addr)) < 0 ||
+            listen(listen_fd, 16) < 0)
+        {
+            log_error("failed to create view feed socket %s: %s",
+                      path.c_str(), strerror(errno));
+
+            if (listen_fd >= 0)
+                close(listen_fd);
+            listen_fd = -1;
+            return;
+        }
+
+        socket_path = path;
+        listen_source = wl_event_loop_add_fd(core->ev_loop, listen_fd,
+                                             WL_EVENT_READABLE, handle_connection, this);
+        log_info("serving view state on %s", path.c_str());
+    }
+
+    void stop()
+    {
+        while (clients.size())
+            disconnect_client(clients.begin()->second);
+
+        if (flush_source)
+            wl_event_source_remove(flush_source);
+        flush_source = NULL;
+
+        if (listen_fd >= 0)
+        {
+            wl_event_source_remove(listen_source);
+            close(listen_fd);
+            unlink(socket_path.c_str());
+        }
+
+        listen_fd = -1;
+        views.clear();
+    }
+
+    /* the state of the view has changed, it will be sent on idle */
+    void view_changed(wayfire_view view)
+    {
+        if (!view || view->role != WF_VIEW_ROLE_TOPLEVEL)
+            return;
+
+        if (view->is_mapped())
+            views[view->get_id()] = view;
+        else
+            views.erase(view->get_id());
+
+        for (auto& c : clients)
+        {
+            if (c.second->fmt != FORMAT_NONE)
+                c.second->dirty.insert(view->get_id());
+        }
+
+        if (!flush_source)
+            flush_source = wl_event_loop_add_idle(core->ev_loop, handle_flush, this);
+    }
+
+    void view_removed(wayfire_view view)
+    {
+        if (!view || !views.count(view->get_id()))
+            return;
+
+        views.erase(view->get_id());
+        for (auto& c : clients)
+        {
+            if (c.second->fmt != FORMAT_NONE)
+                c.second->dirty.insert(view->get_id());
+        }
+
+        if (!flush_source)
+            flush_source = wl_event_loop_add_idle(core->ev_loop, handle_flush, this);
     }
 
-    function idle_func_created = [=] () { update_log_file(); created_idle = NULL; };
-    function idle_func_destroyed = [=] () { update_log_file(); destroyed_idle = NULL; };
+    void focus_changed()
+    {
+        auto output = core->get_active_output();
+        auto active = output ? output->get_active_view() : nullptr;
+        uint32_t id = active ? active->get_id() : no_view;
+
+        if (id == focused_id)
+            return;
+
+        auto it = views.find(focused_id);
+        focused_id = id;
+
+        if (it != views.end())
+            view_changed(it->second);
+        if (active)
+            view_changed(active);
+    }
+};
+
+static wf_view_feed feed;
+
+class wayfire_apps_logger : public wayfire_plugin_t
+{
+    signal_callback_t view_mapped, view_unmapped, view_changed,
+                      focus_changed, viewport_changed;
 
     public:
     void init(wayfire_config *config)
     {
-        created_cb = [=] (signal_data *data)
+        if (feed.refcount++ == 0)
+            feed.start(config->get_section("apps-logger")->get_option("socket", "")->as_string());
+
+        view_mapped = [=] (signal_data *data)
+        {
+            feed.view_changed(get_signaled_view(data));
+            feed.focus_changed();
+        };
+
+        view_unmapped = [=] (signal_data *data)
+        {
+            feed.view_removed(get_signaled_view(data));
+            feed.focus_changed();
+        };
+
+        view_changed = [=] (signal_data *data)
         {
-            if (!created_idle)
-                created_idle = wl_event_loop_add_idle(core->ev_loop, idle_callback, &idle_func_created);
+            auto view = get_signaled_view(data);
+            if (view && view->is_mapped())
+                feed.view_changed(view);
         };
-        output->connect_signal("map-view", &created_cb);
 
-        destroyed_cb = [=] (signal_data *data)
+        focus_changed = [=] (signal_data *data)
         {
-            if (!destroyed_idle)
-                destroyed_idle = wl_event_loop_add_idle(core->ev_loop, idle_callback, &idle_func_destroyed);
+            feed.focus_changed();
         };
-        output->connect_signal("unmap-view", &destroyed_cb);
+
+        /* all views on the output are moved */
+        viewport_changed = [=] (signal_data *data)
+        {
+            output->workspace->for_each_view([] (wayfire_view view)
+            {
+                if (view->is_mapped())
+                    feed.view_changed(view);
+            }, WF_WM_LAYERS);
+        };
+
+        output->connect_signal("map-view", &view_mapped);
+        output->connect_signal("unmap-view", &view_unmapped);
+        output->connect_signal("attach-view", &view_changed);
+        output->connect_signal("view-title-changed", &view_changed);
+        output->connect_signal("view-app-id-changed", &view_changed);
+        output->connect_signal("view-geometry-changed", &view_changed);
+        output->connect_signal("focus-view", &focus_changed);
+        output->connect_signal("output-gain-focus", &focus_changed);
+        output->connect_signal("viewport-changed", &viewport_changed);
+
+        /* views which were mapped before we were loaded */
+        output->workspace->for_each_view([] (wayfire_view view)
+        {
+            if (view->is_mapped())
+                feed.view_changed(view);
+        }, WF_WM_LAYERS);
     }
 
     void fini()
     {
-        output->disconnect_signal("map-view", &created_cb);
-        output->disconnect_signal("unmap-view", &destroyed_cb);
+        output->disconnect_signal("map-view", &view_mapped);
+        output->disconnect_signal("unmap-view", &view_unmapped);
+        output->disconnect_signal("attach-view", &view_changed);
+        output->disconnect_signal("view-title-changed", &view_changed);
+        output->disconnect_signal("view-app-id-changed", &view_changed);
+        output->disconnect_signal("view-geometry-changed", &view_changed);
+        output->disconnect_signal("focus-view", &focus_changed);
+        output->disconnect_signal("output-gain-focus", &focus_changed);
+        output->disconnect_signal("viewport-changed", &viewport_changed);
+
+        output->workspace->for_each_view([] (wayfire_view view)
+        {
+            feed.view_removed(view);
+        }, WF_WM_LAYERS);
 
-        if (created_idle)
-            wl_event_source_remove(created_idle);
-        if (destroyed_idle)
-            wl_event_source_remove(destroyed_idle);
+        if (--feed.refcount == 0)
+            feed.stop();
     }
 };
 
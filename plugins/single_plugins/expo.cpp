@@ -132,9 +132,8 @@ class wayfire_expo : public wayfire_plugin_t
         resized_cb = [=] (signal_data*) {
             for (int i = 0; i < vw; i++) {
                 for (int j = 0; j < vh; j++) {
-                    GL_CALL(glDeleteTextures(1, &streams[i][j]->tex));
-                    GL_CALL(glDeleteFramebuffers(1, &streams[i][j]->fbuff));
-                    streams[i][j]->tex = streams[i][j]->fbuff = -1;
+                    OpenGL::release_render_target(streams[i][j]->fbuff,
+                                                  streams[i][j]->tex);
                 }
             }
         };
@@ -538,8 +537,7 @@ class wayfire_expo : public wayfire_plugin_t
                 {
                     if (stream->running)
                         output->render->workspace_stream_stop(stream);
-                    GL_CALL(glDeleteFramebuffers(1, &stream->fbuff));
-                    GL_CALL(glDeleteTextures(1, &stream->tex));
+                    OpenGL::release_render_target(stream->fbuff, stream->tex);
                 }
             }
         }
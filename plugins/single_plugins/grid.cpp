@@ -4,6 +4,7 @@
 #include <view.hpp>
 #include <workspace-manager.hpp>
 #include <render-manager.hpp>
+#include <layout-transaction.hpp>
 #include <algorithm>
 #include <linux/input-event-codes.h>
 #include "signal-definitions.hpp"
@@ -13,7 +14,6 @@
 #include "snap_signal.hpp"
 #include "../wobbly/wobbly-signal.hpp"
 
-const std::string grid_view_id = "grid-view";
 class wayfire_grid_view : public wf_custom_view_data
 {
     wf_duration duration;
@@ -54,7 +54,7 @@ class wayfire_grid_view : public wf_custom_view_data
             unmapped = [=] (signal_data *data)
             {
                 if (get_signaled_view(data) == view)
-                    view->custom_data.erase(grid_view_id);
+                    view->erase_data<wayfire_grid_view>();
             };
 
             output->render->auto_redraw(true);
@@ -64,7 +64,7 @@ class wayfire_grid_view : public wf_custom_view_data
 
         void destroy()
         {
-            view->custom_data.erase(grid_view_id);
+            view->erase_data<wayfire_grid_view>();
         }
 
         void adjust_target_geometry(wf_geometry geometry, bool tiled)
@@ -81,8 +81,13 @@ class wayfire_grid_view : public wf_custom_view_data
 
             if (type == "none")
             {
-                view->set_maximized(tiled);
-                view->set_geometry(geometry);
+                /* show the view in its new place only when it has the
+                 * new size as well */
+                {
+                    wf_layout_transaction tx;
+                    view->set_maximized(tiled);
+                    tx.set_geometry(view, geometry);
+                }
 
                 return destroy();
             }
@@ -111,7 +116,11 @@ class wayfire_grid_view : public wf_custom_view_data
             if (!duration.running())
             {
                 log_info("direct end %d", tiled);
-                view->set_geometry(target);
+                {
+                    wf_layout_transaction tx;
+                    tx.set_geometry(view, target);
+                }
+
                 view->set_maximized(tiled);
                 view->set_moving(0);
                 view->set_resizing(0);
@@ -145,12 +154,12 @@ class wayfire_grid_view : public wf_custom_view_data
 wayfire_grid_view *ensure_grid_view(wayfire_view view, wayfire_grab_interface iface,
                       wf_option animation_type, wf_option animation_duration)
 {
-    if (view->custom_data.count(grid_view_id))
-        return static_cast<wayfire_grid_view*> (view->custom_data[grid_view_id].get());
+    if (auto data = view->get_data<wayfire_grid_view>())
+        return data;
 
     auto saved = nonstd::make_unique<wayfire_grid_view> (view, iface, animation_type, animation_duration);
     auto ret = saved.get();
-    view->custom_data[grid_view_id] = std::move(saved);
+    view->store_data(wf_get_data_id<wayfire_grid_view>(), std::move(saved));
 
     return ret;
 }
@@ -163,26 +172,33 @@ class saved_view_geometry : public wf_custom_view_data
     bool was_maximized; // used by fullscreen-request
 };
 
+/* the same view can have several saved positions, one per suffix */
+static uint32_t saved_geometry_id(const std::string& suffix)
+{
+    return wf_get_name_id(grid_saved_pos_id + suffix);
+}
+
 bool has_saved_position(wayfire_view view, std::string suffix = "")
 {
-    return view->custom_data.count(grid_saved_pos_id + suffix);
+    return view->get_data(saved_geometry_id(suffix));
 }
 
 saved_view_geometry *ensure_saved_geometry(wayfire_view view, std::string suffix = "")
 {
-    if (has_saved_position(view, suffix))
-        return static_cast<saved_view_geometry*> (view->custom_data[grid_saved_pos_id + suffix].get());
+    auto id = saved_geometry_id(suffix);
+    if (auto data = view->get_data(id))
+        return static_cast<saved_view_geometry*> (data);
 
     auto saved = nonstd::make_unique<saved_view_geometry> ();
     auto ret = saved.get();
-    view->custom_data[grid_saved_pos_id + suffix] = std::move(saved);
+    view->store_data(id, std::move(saved));
 
     return ret;
 }
 
 void erase_saved(wayfire_view view, std::string suffix = "")
 {
-    view->custom_data.erase(grid_saved_pos_id + suffix);
+    view->erase_data(saved_geometry_id(suffix));
 }
 
 class wayfire_grid : public wayfire_plugin_t
@@ -61,7 +61,7 @@ class wayfire_invert_screen : public wayfire_plugin_t
                     output->render->rem_post(&hook);
                 } else
                 {
-                    output->render->add_post(&hook);
+                    output->render->add_post(&hook, true);
                 }
 
                 active = !active;
@@ -0,0 +1,429 @@
+#include <plugin.hpp>
+#include <output.hpp>
+#include <opengl.hpp>
+#include <debug.hpp>
+#include <render-manager.hpp>
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+extern "C"
+{
+#include <wlr/types/wlr_box.h>
+}
+
+/* Records the output to a file, which can then be encoded to a video or
+ * piped to an encoder (the file can be a FIFO).
+ *
+ * Only the part of the screen which has changed is read back, into a ring of
+ * pixel pack buffers, so that the GPU copies the pixels while we continue
+ * with the next frame. The buffers are mapped a frame or two later, when
+ * their fence has signaled, and the frames are written by a separate thread.
+ *
+ * The stream has a header and then one record per frame, all integers in
+ * native byte order:
+ *
+ *     header: "WFREC001", uint32 width, uint32 height
+ *     frame:  uint64 time (CLOCK_MONOTONIC, usec), uint32 rect count,
+ *             for each rect: int32 x, y, width, height and then the pixels
+ *             (RGBA, bottom row first, as returned by glReadPixels())
+ *
+ * Rects are in framebuffer coordinates. The first frame covers the whole
+ * output, each next frame has only what changed since the previous one */
+
+/* how many frames can be read back at the same time */
+static const int readback_slots = 3;
+/* beyond this, the damage is recorded as a single rect */
+static const int max_rects_per_frame = 16;
+/* frames the writer thread hasn't written yet, at most */
+static const size_t max_queued_bytes = 256 * 1024 * 1024;
+
+class wf_recording_writer
+{
+    int fd = -1;
+    std::thread thread;
+
+    std::mutex mutex;
+    std::condition_variable frames_available;
+    std::deque<std::vector<uint8_t>> queue;
+    size_t queued_bytes = 0;
+    bool done = false;
+
+    static bool write_all(int fd, const uint8_t *data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t r = write(fd, data, size);
+            if (r < 0 && errno == EINTR)
+                continue;
+
+            if (r < 0)
+                return false;
+
+            data += r;
+            size -= r;
+        }
+
+        return true;
+    }
+
+    void run()
+    {
+        bool failed = false;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            frames_available.wait(lock, [=] { return done || !queue.empty(); });
+            if (queue.empty())
+                return;
+
+            auto frame = std::move(queue.front());
+            queue.pop_front();
+            queued_bytes -= frame.size();
+
+            lock.unlock();
+            if (!failed && !write_all(fd, frame.data(), frame.size()))
+            {
+                log_error("recorder: failed to write frame: %s", strerror(errno));
+                failed = true;
+            }
+            lock.lock();
+        }
+    }
+
+    public:
+    bool open(const std::string& path, uint32_t width, uint32_t height)
+    {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            log_error("recorder: failed to open %s: %s", path.c_str(), strerror(errno));
+            return false;
+        }
+
+        uint8_t header[16];
+        std::memcpy(header, "WFREC001", 8);
+        std::memcpy(header + 8, &width, 4);
+        std::memcpy(header + 12, &height, 4);
+
+        if (!write_all(fd, header, sizeof(header)))
+        {
+            log_error("recorder: failed to write %s: %s", path.c_str(), strerror(errno));
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+
+        done = false;
+        thread = std::thread([=] { run(); });
+        return true;
+    }
+
+    /* returns false if the writer is too far behind and the frame was dropped */
+    bool push(std::vector<uint8_t>&& frame)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queued_bytes + frame.size() > max_queued_bytes)
+            return false;
+
+        queued_bytes += frame.size();
+        queue.push_back(std::move(frame));
+        frames_available.notify_one();
+
+        return true;
+    }
+
+    /* writes the remaining frames and closes the file */
+    void close()
+    {
+        if (fd < 0)
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+            frames_available.notify_one();
+        }
+
+        thread.join();
+        ::close(fd);
+        fd = -1;
+    }
+
+    ~wf_recording_writer()
+    {
+        close();
+    }
+};
+
+class wayfire_recorder : public wayfire_plugin_t
+{
+    struct readback_t
+    {
+        GLuint pbo = 0;
+        size_t capacity = 0, size = 0;
+        GLsync fence = nullptr;
+
+        uint64_t time;
+        std::vector<wlr_box> rects;
+    };
+
+    readback_t slots[readback_slots];
+    int next_slot = 0;
+
+    /* changed since the last frame we have read */
+    pixman_region32_t pending_damage;
+
+    wf_recording_writer writer;
+    bool recording = false, stopping = false;
+
+    std::string directory, file;
+    key_callback toggle_cb;
+    capture_hook_t capture_hook;
+
+    public:
+    void init(wayfire_config *config)
+    {
+        grab_interface->name = "recorder";
+        grab_interface->abilities_mask = WF_ABILITY_RECORD_SCREEN;
+
+        auto section = config->get_section("recorder");
+        auto toggle_key = section->get_option("toggle", "<super> <alt> KEY_R");
+        directory = section->get_option("directory", "/tmp")->as_string();
+        file = section->get_option("file", "")->as_string();
+
+        pixman_region32_init(&pending_damage);
+
+        toggle_cb = [=] (uint32_t)
+        {
+            if (!recording)
+                start();
+            else
+                stop();
+        };
+
+        capture_hook = [=] (pixman_region32_t *damage)
+        {
+            capture(damage);
+        };
+
+        output->add_key(toggle_key, &toggle_cb);
+    }
+
+    void start()
+    {
+        if (!output->activate_plugin(grab_interface))
+            return;
+
+        char name[64];
+        time_t now = time(NULL);
+        strftime(name, sizeof(name), "%Y%m%d-%H%M%S", localtime(&now));
+
+        std::string path = file;
+        if (path.empty())
+        {
+            path = directory + "/wayfire-" + output->handle->name +
+                "-" + name + ".wfrec";
+        }
+
+        if (!writer.open(path, output->handle->width, output->handle->height))
+        {
+            output->deactivate_plugin(grab_interface);
+            return;
+        }
+
+        log_info("recording output %s to %s", output->handle->name, path.c_str());
+
+        recording = true;
+        stopping = false;
+        next_slot = 0;
+        pixman_region32_clear(&pending_damage);
+
+        /* the first frame covers the whole output */
+        output->render->add_capture(&capture_hook);
+    }
+
+    /* the GL resources are released from the capture hook, where we know
+     * the context of the output is current */
+    void stop()
+    {
+        stopping = true;
+        output->render->damage(NULL);
+    }
+
+    void finish()
+    {
+        collect(true);
+        for (auto& slot : slots)
+        {
+            /* the GPU didn't finish in time, give up on the frame */
+            if (slot.fence)
+                glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+
+            if (slot.pbo)
+                GL_CALL(glDeleteBuffers(1, &slot.pbo));
+
+            slot.pbo = 0;
+            slot.capacity = 0;
+        }
+
+        writer.close();
+        output->render->rem_capture(&capture_hook);
+        output->deactivate_plugin(grab_interface);
+
+        recording = stopping = false;
+        log_info("stopped recording output %s", output->handle->name);
+    }
+
+    static uint64_t get_time()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+    }
+
+    /* hand the finished readbacks to the writer, oldest first */
+    void collect(bool wait)
+    {
+        for (int i = 0; i < readback_slots; i++)
+        {
+            auto& slot = slots[(next_slot + i) % readback_slots];
+            if (!slot.fence)
+                continue;
+
+            auto status = glClientWaitSync(slot.fence, 0, wait ? 1000000000ull : 0);
+            if (status == GL_TIMEOUT_EXPIRED)
+                return;
+
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+
+            if (status == GL_WAIT_FAILED)
+                continue;
+
+            size_t header_size = 12 + 16 * slot.rects.size();
+            std::vector<uint8_t> frame(header_size + slot.size);
+
+            uint32_t n_rects = slot.rects.size();
+            std::memcpy(&frame[0], &slot.time, 8);
+            std::memcpy(&frame[8], &n_rects, 4);
+            for (size_t j = 0; j < slot.rects.size(); j++)
+            {
+                const auto& r = slot.rects[j];
+                int32_t box[4] = {r.x, r.y, r.width, r.height};
+                std::memcpy(&frame[12 + 16 * j], box, 16);
+            }
+
+            GL_CALL(glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo));
+            auto pixels = GL_CALL(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                                                   slot.size, GL_MAP_READ_BIT));
+            if (pixels)
+            {
+                std::memcpy(&frame[header_size], pixels, slot.size);
+                GL_CALL(glUnmapBuffer(GL_PIXEL_PACK_BUFFER));
+            }
+
+            GL_CALL(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+
+            /* the next frame must be complete, since this delta is lost */
+            if (!pixels || !writer.push(std::move(frame)))
+            {
+                log_error("recorder: dropped a frame, recording the whole output again");
+                output->render->damage(NULL);
+            }
+        }
+    }
+
+    void capture(pixman_region32_t *damage)
+    {
+        collect(false);
+        if (stopping)
+            return finish();
+
+        pixman_region32_union(&pending_damage, &pending_damage, damage);
+        if (!pixman_region32_not_empty(&pending_damage))
+            return;
+
+        /* the GPU is still copying older frames. We'll read this damage
+         * with the next frame instead */
+        auto& slot = slots[next_slot];
+        if (slot.fence)
+            return;
+
+        int n_rect;
+        auto rects = pixman_region32_rectangles(&pending_damage, &n_rect);
+
+        slot.rects.clear();
+        if (n_rect > max_rects_per_frame)
+        {
+            auto e = pixman_region32_extents(&pending_damage);
+            slot.rects.push_back({e->x1, e->y1, e->x2 - e->x1, e->y2 - e->y1});
+        } else
+        {
+            for (int i = 0; i < n_rect; i++)
+            {
+                slot.rects.push_back({rects[i].x1, rects[i].y1,
+                                      rects[i].x2 - rects[i].x1,
+                                      rects[i].y2 - rects[i].y1});
+            }
+        }
+
+        slot.size = 0;
+        for (auto& r : slot.rects)
+            slot.size += 4ull * r.width * r.height;
+
+        if (!slot.pbo)
+            GL_CALL(glGenBuffers(1, &slot.pbo));
+
+        GL_CALL(glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo));
+        if (slot.capacity < slot.size)
+        {
+            GL_CALL(glBufferData(GL_PIXEL_PACK_BUFFER, slot.size, NULL, GL_STREAM_READ));
+            slot.capacity = slot.size;
+        }
+
+        /* with a pack buffer bound, glReadPixels() returns immediately */
+        size_t offset = 0;
+        for (auto& r : slot.rects)
+        {
+            GL_CALL(glReadPixels(r.x, r.y, r.width, r.height, GL_RGBA,
+                                 GL_UNSIGNED_BYTE, (void*)offset));
+            offset += 4ull * r.width * r.height;
+        }
+
+        GL_CALL(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.time = get_time();
+
+        next_slot = (next_slot + 1) % readback_slots;
+        pixman_region32_clear(&pending_damage);
+    }
+
+    void fini()
+    {
+        if (recording)
+            finish();
+
+        output->rem_key(&toggle_cb);
+        pixman_region32_fini(&pending_damage);
+    }
+};
+
+extern "C"
+{
+    wayfire_plugin_t *newInstance()
+    {
+        return new wayfire_recorder();
+    }
+}
@@ -9,6 +9,7 @@
 #include <queue>
 #include <linux/input-event-codes.h>
 #include <algorithm>
+#include <cmath>
 
 enum paint_attribs
 {
@@ -20,6 +21,9 @@ enum paint_attribs
 struct view_paint_attribs
 {
     wayfire_view view;
+    /* looked up once, when the animation starts */
+    wf_3D_view *transform;
+
     wf_transition scale_x, scale_y, off_x, off_y, off_z;
     wf_transition rot;
 
@@ -100,6 +104,9 @@ class wayfire_view_switcher : public wayfire_plugin_t
 
     wf_option view_scale_config;
 
+    /* the id of our transformer's name, looked up for each view at each frame */
+    const uint32_t transformer_id = wf_get_name_id("switcher");
+
     public:
 
     void init(wayfire_config *config)
@@ -205,12 +212,13 @@ class wayfire_view_switcher : public wayfire_plugin_t
         {
             auto bg = bgl[0];
 
-            bg->add_transformer(std::unique_ptr<wf_3D_view> (new wf_3D_view(bg)), "switcher");
-            auto tr = dynamic_cast<wf_3D_view*> (bg->get_transformer("switcher").get());
-            assert(tr);
+            auto tr = new wf_3D_view(bg);
+            bg->add_transformer(std::unique_ptr<wf_3D_view> (tr), transformer_id);
 
+            /* the background doesn't change while switching, so its snapshot
+             * is rendered only once */
             tr->color = {0.6, 0.6, 0.6, 1.0};
-            tr->scaling = glm::scale(glm::mat4(1.0f), glm::vec3(1, 1, 1));
+            tr->set_scaling(glm::scale(glm::mat4(1.0f), glm::vec3(1, 1, 1)));
         }
     }
 
@@ -297,12 +305,20 @@ class wayfire_view_switcher : public wayfire_plugin_t
     {
         for (auto v : views)
         {
-            auto tr = v->get_transformer("switcher");
+            auto tr = v->get_transformer(transformer_id);
             if (!tr)
-                v->add_transformer(std::unique_ptr<wf_3D_view> (new wf_3D_view(v)), "switcher");
+                v->add_transformer(std::unique_ptr<wf_3D_view> (new wf_3D_view(v)), transformer_id);
         }
     }
 
+    wf_3D_view *get_transform(wayfire_view view)
+    {
+        auto tr = static_cast<wf_3D_view*> (view->get_transformer(transformer_id).get());
+        assert(tr);
+
+        return tr;
+    }
+
     void view_chosen(int i)
     {
         for (int i = views.size() - 1; i >= 0; i--)
@@ -372,6 +388,7 @@ class wayfire_view_switcher : public wayfire_plugin_t
 
             view_paint_attribs elem;
             elem.view = v;
+            elem.transform = get_transform(v);
             elem.off_z = {0, 0};
 
             if (state.reversed_folds)
@@ -398,32 +415,40 @@ class wayfire_view_switcher : public wayfire_plugin_t
         auto &duration = initial_animation.running() ?
             initial_animation : regular_animation;
 
-        for (auto v : active_views)
+        for (auto& v : active_views)
         {
-            auto tr = dynamic_cast<wf_3D_view*> (v.view->get_transformer("switcher").get());
-            assert(tr);
+            auto tr = v.transform;
 
-            v.view->damage();
+            /* only the transform changes, the view's snapshot stays valid */
+            v.view->damage_bounding_box();
             if (v.updates & UPDATE_OFFSET)
             {
-                tr->translation = glm::translate(glm::mat4(1.0), glm::vec3(
+                tr->set_translation(glm::translate(glm::mat4(1.0), glm::vec3(
                             duration.progress(v.off_x),
                             duration.progress(v.off_y),
-                            duration.progress(v.off_z)));
+                            duration.progress(v.off_z))));
             }
             if (v.updates & UPDATE_SCALE)
             {
-                tr->scaling = glm::scale(glm::mat4(1.0), glm::vec3(
-                        duration.progress(v.scale_x), duration.progress(v.scale_y), 1));
+                float scale_x = duration.progress(v.scale_x);
+                float scale_y = duration.progress(v.scale_y);
+
+                tr->set_scaling(glm::scale(glm::mat4(1.0), glm::vec3(scale_x, scale_y, 1)));
+
+                /* views are never shown bigger than that, so render their
+                 * snapshot as a thumbnail of the same size. Round up, so that
+                 * the thumbnail isn't reallocated on every frame */
+                float thumb_scale = std::max(scale_x, scale_y);
+                v.view->set_snapshot_scale(std::ceil(thumb_scale * 8) / 8);
             }
             if (v.updates & UPDATE_ROTATION)
             {
-                tr->rotation = glm::rotate(glm::mat4(1.0),
-                                           (float)duration.progress(v.rot),
-                                           glm::vec3(0, 1, 0));
+                tr->set_rotation(glm::rotate(glm::mat4(1.0),
+                                             (float)duration.progress(v.rot),
+                                             glm::vec3(0, 1, 0)));
             }
 
-            v.view->damage();
+            v.view->damage_bounding_box();
         }
     }
 
@@ -476,6 +501,7 @@ class wayfire_view_switcher : public wayfire_plugin_t
 
         view_paint_attribs elem;
         elem.view = v;
+        elem.transform = get_transform(v);
         elem.off_x = {cx + off_x.start * sw / 2.0f, cx + off_x.end * sw / 2.0f};
         elem.off_y = {cy, cy};
         elem.off_z = off_z;
@@ -642,12 +668,15 @@ class wayfire_view_switcher : public wayfire_plugin_t
         if (bgl.size())
         {
             auto bg = bgl[0];
-            bg->pop_transformer("switcher");
+            bg->pop_transformer(transformer_id);
         }
 
         log_info("reset tranforms");
         for(auto v : views)
-            v->pop_transformer("switcher");
+        {
+            v->pop_transformer(transformer_id);
+            v->set_snapshot_scale(1);
+        }
 
         state.active = false;
         view_chosen(current_view_index);
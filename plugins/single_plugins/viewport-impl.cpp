@@ -8,7 +8,7 @@
 #include <nonstd/make_unique.hpp>
 #include <pixman-1/pixman.h>
 #include <opengl.hpp>
-#include <list>
+#include <vector>
 #include <algorithm>
 
 struct wf_default_workspace_implementation : public wf_workspace_implementation
@@ -18,38 +18,65 @@ struct wf_default_workspace_implementation : public wf_workspace_implementation
     virtual ~wf_default_workspace_implementation() {}
 };
 
-using wf_layer_container = std::list<wayfire_view>;
-
-class viewport_manager : public workspace_manager
+/* The views of a layer, bottom-most first. Each view knows the index of
+ * its slot, so removing a view just clears its slot and raising it moves
+ * it to a new slot at the end. Empty slots are squeezed out once they
+ * outnumber the views, which keeps the array short and walks contiguous */
+class wf_layer_container
 {
-    static const int TOTAL_WF_LAYERS = 6;
-    struct custom_layer_data_t : public wf_custom_view_data
-    {
-        static const std::string name;
-        uint32_t layer = 0;
-    };
+    std::vector<wayfire_view> slots;
+    size_t count = 0;
 
-    uint32_t& _get_view_layer(wayfire_view view)
+    void compact()
     {
-        auto it = view->custom_data.find(custom_layer_data_t::name);
-        custom_layer_data_t *layer_data = nullptr;
-
-        if (it == view->custom_data.end())
+        size_t j = 0;
+        for (size_t i = 0; i < slots.size(); i++)
         {
-            auto data = nonstd::make_unique<custom_layer_data_t>();
+            if (!slots[i])
+                continue;
 
-            layer_data = data.get();
-            view->custom_data[custom_layer_data_t::name] = std::move(data);
-        } else
-        {
-            layer_data = dynamic_cast<custom_layer_data_t*> (it->second.get());
+            slots[i]->layer_slot.index = j;
+            slots[j++] = slots[i];
         }
 
-        assert(layer_data);
+        slots.resize(j);
+    }
+
+    public:
+    /* place the view on top of the layer */
+    void push_top(wayfire_view view)
+    {
+        view->layer_slot.index = slots.size();
+        slots.push_back(view);
+        ++count;
+    }
+
+    void remove(wayfire_view view)
+    {
+        auto& slot = slots[view->layer_slot.index];
+        assert(slot == view);
 
-        return layer_data->layer;
+        slot = nullptr;
+        --count;
+
+        if (slots.size() > 2 * count + 8)
+            compact();
+    }
+
+    /* call f for each view, top-most first */
+    template<class F> void for_each(F f) const
+    {
+        for (auto it = slots.rbegin(); it != slots.rend(); ++it)
+        {
+            if (*it)
+                f(*it);
+        }
     }
+};
 
+class viewport_manager : public workspace_manager
+{
+    static const int TOTAL_WF_LAYERS = 6;
 
     private:
         int vwidth, vheight, vx, vy;
@@ -109,8 +136,6 @@ class viewport_manager : public workspace_manager
         wf_geometry get_workarea();
 };
 
-const std::string viewport_manager::custom_layer_data_t::name = "__layer_data";
-
 /* Start viewport_manager */
 void viewport_manager::init(wayfire_output *o)
 {
@@ -168,10 +193,7 @@ viewport_manager::~viewport_manager()
 
 void viewport_manager::remove_from_layer(wayfire_view view, uint32_t layer)
 {
-    auto& layer_container = layers[layer];
-
-    auto it = std::remove(layer_container.begin(), layer_container.end(), view);
-    layer_container.erase(it, layer_container.end());
+    layers[layer].remove(view);
 }
 
 void viewport_manager::add_view_to_layer(wayfire_view view, uint32_t layer)
@@ -181,7 +203,7 @@ void viewport_manager::add_view_to_layer(wayfire_view view, uint32_t layer)
     log_info("add to layer %d", layer);
 
     view->damage();
-    auto& current_layer = _get_view_layer(view);
+    auto& current_layer = view->layer_slot.layer;
     if (layer == 0)
     {
         if (current_layer)
@@ -206,15 +228,14 @@ void viewport_manager::add_view_to_layer(wayfire_view view, uint32_t layer)
     if (current_layer)
         remove_from_layer(view, layer_index_from_mask(current_layer));
 
-    auto& layer_container = layers[layer_index_from_mask(layer)];
-    layer_container.push_front(view);
+    layers[layer_index_from_mask(layer)].push_top(view);
     current_layer = layer;
     view->damage();
 }
 
 uint32_t viewport_manager::get_view_layer(wayfire_view view)
 {
-    return _get_view_layer(view);
+    return view->layer_slot.layer;
 }
 
 bool viewport_manager::view_visible_on(wayfire_view view, std::tuple<int, int> vp)
@@ -243,8 +264,7 @@ void viewport_manager::for_each_view(view_callback_proc_t call, uint32_t layers_
     for (int i = TOTAL_WF_LAYERS - 1; i >= 0; i--)
     {
         if ((1 << i) & layers_mask)
-            for (auto v : layers[i])
-                views.push_back(v);
+            layers[i].for_each([&] (wayfire_view v) { views.push_back(v); });
     }
 
     for (auto v : views)
@@ -258,8 +278,7 @@ void viewport_manager::for_each_view_reverse(view_callback_proc_t call, uint32_t
     for (int i = TOTAL_WF_LAYERS - 1; i >= 0; i--)
     {
         if ((1 << i) & layers_mask)
-            for (auto v : layers[i])
-                views.push_back(v);
+            layers[i].for_each([&] (wayfire_view v) { views.push_back(v); });
     }
 
     auto it = views.rbegin();
@@ -349,23 +368,20 @@ viewport_manager::get_views_on_workspace(std::tuple<int, int> vp,
 {
 
     std::vector<wayfire_view> views;
+    auto og = output->get_relative_geometry();
 
-    for (int i = 5; i >= 0; i--)
+    for (int i = TOTAL_WF_LAYERS - 1; i >= 0; i--)
     {
-        if ((1 << i) & layers_mask)
+        if (!((1 << i) & layers_mask))
+            continue;
+
+        layers[i].for_each([&] (wayfire_view v)
         {
-            for (auto v : layers[i])
-            {
-                if (wm_only && rect_intersect(output->get_relative_geometry(), v->get_wm_geometry()))
-                {
-                    views.push_back(v);
-                }
-                else if (!wm_only && view_visible_on(v, vp))
-                {
-                    views.push_back(v);
-                }
-            }
-        }
+            if (wm_only && rect_intersect(og, v->get_wm_geometry()))
+                views.push_back(v);
+            else if (!wm_only && view_visible_on(v, vp))
+                views.push_back(v);
+        });
     }
 
     return views;
@@ -452,6 +468,10 @@ void viewport_manager::reflow_reserved_areas()
         }
     }
 
+    /* the panels might have moved, but nothing else has to change */
+    if (current_workarea == old_workarea)
+        return;
+
     reserved_workarea_signal data;
     data.old_workarea = old_workarea;
     data.new_workarea = current_workarea;
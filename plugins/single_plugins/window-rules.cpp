@@ -1,9 +1,14 @@
 #include <output.hpp>
+#include <core.hpp>
 #include <view.hpp>
 #include <cwctype>
 #include <cstdio>
 #include <signal-definitions.hpp>
 #include <assert.h>
+#include <algorithm>
+#include <unordered_map>
+#include <map>
+#include <queue>
 
 using std::string;
 
@@ -24,6 +29,10 @@ examples:
 title contains Chrome created -> set maximized
 app-id tilix created -> move 0 0
 
+The rules are compiled when the config is loaded: for each event, exact
+matches are looked up in a hash table and all "contains" patterns are
+matched at once with an Aho-Corasick automaton, so a view is checked
+against all rules with a single pass over its title and app-id.
  */
 
 static string trim(string x)
@@ -49,128 +58,224 @@ static bool ends_with(string x, string y)
 }
 
 
-class wayfire_window_rules : public wayfire_plugin_t
-{
-
+using action_func = std::function<void(wayfire_view view)>;
 
-    using verification_func = std::function<bool(wayfire_view, std::string)>;
-
-    struct verificator
+/* Aho-Corasick automaton, finds which of the patterns are contained in a
+ * string in a single pass over the string */
+class wf_substring_matcher
+{
+    struct node
     {
-        verification_func func;
-        std::string atom;
+        std::map<unsigned char, int> next;
+        int fail = 0;
+        /* the closest node on the failure chain which ends a pattern, or -1 */
+        int output_link = -1;
+        /* values of the patterns which end at this node */
+        std::vector<int> values;
     };
 
-    std::vector<verificator> verficators =
+    std::vector<node> nodes = std::vector<node>(1);
+
+    public:
+    void add(const std::string& pattern, int value)
     {
-        {  [] (wayfire_view view, std::string match) -> bool
-            {
-                auto title = view->get_title();
-                return title.find(match) != std::string::npos;
-            },
-            "title contains"
-        },
-        { [] (wayfire_view view, std::string match) -> bool
+        int current = 0;
+        for (unsigned char c : pattern)
+        {
+            auto it = nodes[current].next.find(c);
+            if (it == nodes[current].next.end())
             {
-                auto title = view->get_title();
-                return title == match;
-            },
-            "title"
-        },
-        {  [] (wayfire_view view, std::string match) -> bool
+                nodes.push_back(node());
+                nodes[current].next[c] = nodes.size() - 1;
+                current = nodes.size() - 1;
+            } else
             {
-                auto app_id = view->get_app_id();
-                return app_id.find(match) != std::string::npos;
-            },
-            "app-id contains"
-        },
-        {  [] (wayfire_view view, std::string match) -> bool
+                current = it->second;
+            }
+        }
+
+        nodes[current].values.push_back(value);
+    }
+
+    /* must be called after all patterns have been added */
+    void compile()
+    {
+        std::queue<int> queue;
+        for (auto& edge : nodes[0].next)
+            queue.push(edge.second);
+
+        /* breadth-first, so that the failure links of shorter prefixes are known */
+        while (!queue.empty())
+        {
+            int u = queue.front();
+            queue.pop();
+
+            for (auto& edge : nodes[u].next)
             {
-                auto app_id = view->get_app_id();
-                return app_id == match;
-            },
-            "app-id"
-        },
-    };
+                int v = edge.second;
+                queue.push(v);
 
-    std::vector<std::string> events = {
-        "created", "maximized", "fullscreened"
-    };
+                if (u == 0)
+                    continue;
 
-    using action_func = std::function<void(wayfire_view view)>;
+                int f = nodes[u].fail;
+                while (f && !nodes[f].next.count(edge.first))
+                    f = nodes[f].fail;
 
-    struct lambda_executor
+                auto it = nodes[f].next.find(edge.first);
+                nodes[v].fail = it == nodes[f].next.end() ? 0 : it->second;
+
+                int fail = nodes[v].fail;
+                nodes[v].output_link = (fail && nodes[fail].values.size()) ?
+                    fail : nodes[fail].output_link;
+            }
+        }
+    }
+
+    /* append the values of all patterns found in text */
+    void match(const std::string& text, std::vector<int>& result) const
     {
-        verification_func verify;
-        std::string verification_string;
-        action_func action;
-    };
+        /* the empty pattern */
+        result.insert(result.end(), nodes[0].values.begin(), nodes[0].values.end());
+
+        int current = 0;
+        for (unsigned char c : text)
+        {
+            while (true)
+            {
+                auto it = nodes[current].next.find(c);
+                if (it != nodes[current].next.end())
+                {
+                    current = it->second;
+                    break;
+                }
 
-    using rule_func = std::function<void(wayfire_view)>;
-    struct rule
+                if (current == 0)
+                    break;
+
+                current = nodes[current].fail;
+            }
+
+            int n = nodes[current].values.size() ? current : nodes[current].output_link;
+            for (; n > 0; n = nodes[n].output_link)
+                result.insert(result.end(), nodes[n].values.begin(), nodes[n].values.end());
+        }
+    }
+};
+
+/* the rules for one event */
+class wf_rule_index
+{
+    enum field
     {
-        std::string signal;
-        std::function<void(wayfire_view)> func;
+        FIELD_TITLE  = 0,
+        FIELD_APP_ID = 1,
+        FIELD_TOTAL  = 2
     };
 
-    rule parse_add_rule(std::string rule)
+    std::unordered_map<std::string, std::vector<int>> exact[FIELD_TOTAL];
+    wf_substring_matcher contains[FIELD_TOTAL];
+
+    /* indexed by rule number, in the order of the config file */
+    std::vector<action_func> actions;
+
+    public:
+    /* returns false if the predicate is invalid */
+    bool add(const std::string& predicate, action_func action)
     {
-        std::string predicate, action;
-        struct rule result;
+        static const struct
+        {
+            std::string atom;
+            field f;
+            bool substring;
+        } atoms[] =
+        {
+            /* longer atoms first, "title" is a prefix of "title contains" */
+            {"title contains",  FIELD_TITLE,  true},
+            {"title",           FIELD_TITLE,  false},
+            {"app-id contains", FIELD_APP_ID, true},
+            {"app-id",          FIELD_APP_ID, false},
+        };
 
-        size_t pos = 0;
-        for (; pos < rule.size() - 2; ++pos)
+        for (auto& a : atoms)
         {
-            if (rule[pos] == '-' && rule[pos + 1] == '>')
-                break;
-        }
+            if (!starts_with(predicate, a.atom))
+                continue;
 
-        /* first condition is so that there is no underflow in unsigned arithmetic */
-        if (rule.size() <= 5 || pos >= rule.size() - 2 || pos < 1)
-            return result;
+            auto match = trim(predicate.substr(a.atom.length()));
+            int id = actions.size();
 
-        predicate = trim(rule.substr(0, pos));
-        std::string event;
-        action = trim(rule.substr(pos + 2, rule.size() - pos - 1));
+            if (a.substring)
+                contains[a.f].add(match, id);
+            else
+                exact[a.f][match].push_back(id);
 
-        for (auto ev : events)
-        {
-            if (ends_with(predicate, ev))
-            {
-                event = ev;
-                predicate = trim(predicate.substr(0, predicate.length() - ev.length()));
-                break;
-            }
+            actions.push_back(action);
+            return true;
         }
 
-        lambda_executor exec;
-        exec.verify = nullptr;
-        exec.action = nullptr;
+        return false;
+    }
+
+    void compile()
+    {
+        for (int i = 0; i < FIELD_TOTAL; i++)
+            contains[i].compile();
+    }
+
+    void apply(wayfire_view view) const
+    {
+        if (actions.empty())
+            return;
+
+        std::string values[FIELD_TOTAL] = {view->get_title(), view->get_app_id()};
 
-        for (const auto& pred : verficators)
+        std::vector<int> matched;
+        for (int i = 0; i < FIELD_TOTAL; i++)
         {
-            if (starts_with(predicate, pred.atom))
-            {
-                exec.verify = pred.func;
-                exec.verification_string =
-                    trim(predicate.substr(pred.atom.length(),
-                                          predicate.length() - pred.atom.length()));
-                break;
-            }
+            auto it = exact[i].find(values[i]);
+            if (it != exact[i].end())
+                matched.insert(matched.end(), it->second.begin(), it->second.end());
+
+            contains[i].match(values[i], matched);
         }
 
-        if (!exec.verify || !event.length())
-            return result;
+        /* run each rule once, in the order they were given */
+        std::sort(matched.begin(), matched.end());
+        matched.erase(std::unique(matched.begin(), matched.end()), matched.end());
+
+        for (auto id : matched)
+            actions[id](view);
+    }
+};
+
+class wayfire_window_rules : public wayfire_plugin_t
+{
+    enum event
+    {
+        EVENT_CREATED      = 0,
+        EVENT_MAXIMIZED    = 1,
+        EVENT_FULLSCREENED = 2,
+        EVENT_TOTAL        = 3
+    };
+
+    const std::string event_names[EVENT_TOTAL] = {
+        "created", "maximized", "fullscreened"
+    };
+
+    wf_rule_index rules[EVENT_TOTAL];
 
+    action_func parse_action(std::string action)
+    {
         if (starts_with(action, "move"))
         {
             int x, y;
             int t = std::sscanf(action.c_str(), "move %d %d", &x, &y);
 
             if (t != 2)
-                return result;
+                return nullptr;
 
-            exec.action = [x,y] (wayfire_view view) {
+            return [x,y] (wayfire_view view) {
                 auto og = view->get_output()->get_relative_geometry();
                 view->move(og.x + x, og.y + y);
             };
@@ -180,9 +285,9 @@ class wayfire_window_rules : public wayfire_plugin_t
             int t = std::sscanf(action.c_str(), "resize %d %d", &w, &h);
 
             if (t != 2 || w <= 0 || h <= 0)
-                return result;
+                return nullptr;
 
-            exec.action = [w,h] (wayfire_view view) mutable {
+            return [w,h] (wayfire_view view) mutable {
                 GetTuple(sw, sh, view->get_output()->get_screen_size());
                 if (w > 100000)
                     w = sw;
@@ -192,58 +297,77 @@ class wayfire_window_rules : public wayfire_plugin_t
             };
         } else if (ends_with(action, "set maximized"))
         {
-            exec.action = [action] (wayfire_view view)
+            bool state = starts_with(action, "set");
+            return [state] (wayfire_view view)
             {
                 view_maximized_signal data;
                 data.view = view;
-                data.state = starts_with(action, "set");
+                data.state = state;
                 view->get_output()->emit_signal("view-maximized-request", &data);
             };
         }
 
         else if (ends_with(action, "set fullscreen"))
         {
-            exec.action = [action] (wayfire_view view)
+            bool state = starts_with(action, "set");
+            return [state] (wayfire_view view)
             {
                 view_fullscreen_signal data;
                 data.view = view;
-                data.state = starts_with(action, "set");
+                data.state = state;
                 view->get_output()->emit_signal("view-fullscreen-request", &data);
             };
         }
 
+        return nullptr;
+    }
 
-        if (!exec.action)
-            return result;
+    void parse_add_rule(std::string rule)
+    {
+        size_t pos = rule.find("->");
 
-        result.signal = event;
-        result.func = [exec] (wayfire_view view)
-        {
-            if (exec.verify(view, exec.verification_string))
-                exec.action(view);
-        };
+        if (rule.size() <= 5 || pos == std::string::npos || pos < 1)
+            return;
+
+        auto predicate = trim(rule.substr(0, pos));
+        auto action = parse_action(trim(rule.substr(pos + 2)));
+        if (!action)
+            return;
 
-        return result;
+        for (int ev = 0; ev < EVENT_TOTAL; ev++)
+        {
+            if (ends_with(predicate, event_names[ev]))
+            {
+                predicate = trim(predicate.substr(0, predicate.length() - event_names[ev].length()));
+                rules[ev].add(predicate, action);
+                return;
+            }
+        }
     }
 
-    signal_callback_t created, maximized, fullscreened;
+    void load_rules(wayfire_config *config)
+    {
+        for (int i = 0; i < EVENT_TOTAL; i++)
+            rules[i] = wf_rule_index();
 
-    std::map<std::string, std::vector<rule_func>> rules_list;
+        auto section = config->get_section("window-rules");
+        for (auto opt : section->options)
+            parse_add_rule(opt->as_string());
+
+        for (int i = 0; i < EVENT_TOTAL; i++)
+            rules[i].compile();
+    }
+
+    signal_callback_t created, maximized, fullscreened, reload_config;
 
     public:
     void init(wayfire_config *config)
     {
-        auto section = config->get_section("window-rules");
-        for (auto opt : section->options)
-        {
-            auto rule = parse_add_rule(opt->as_string());
-            rules_list[rule.signal].push_back(rule.func);
-        }
+        load_rules(config);
 
         created = [=] (signal_data *data)
         {
-            for (const auto& rule : rules_list["created"])
-                rule(get_signaled_view(data));
+            rules[EVENT_CREATED].apply(get_signaled_view(data));
         };
         output->connect_signal("map-view", &created);
 
@@ -255,8 +379,7 @@ class wayfire_window_rules : public wayfire_plugin_t
             if (!conv->state)
                 return;
 
-            for (const auto& rule : rules_list["maximized"])
-                rule(conv->view);
+            rules[EVENT_MAXIMIZED].apply(conv->view);
         };
         output->connect_signal("view-maximized", &maximized);
 
@@ -268,10 +391,15 @@ class wayfire_window_rules : public wayfire_plugin_t
             if (!conv->state)
                 return;
 
-            for (const auto& rule : rules_list["fullscreened"])
-                rule(conv->view);
+            rules[EVENT_FULLSCREENED].apply(conv->view);
         };
         output->connect_signal("view-fullscreen", &fullscreened);
+
+        reload_config = [=] (signal_data*)
+        {
+            load_rules(core->config);
+        };
+        output->connect_signal("reload-config", &reload_config);
     }
 
     void fini()
@@ -279,6 +407,7 @@ class wayfire_window_rules : public wayfire_plugin_t
         output->disconnect_signal("map-view", &created);
         output->disconnect_signal("view-maximized", &maximized);
         output->disconnect_signal("view-fullscreen", &fullscreened);
+        output->disconnect_signal("reload-config", &reload_config);
     }
 };
 
@@ -22,6 +22,8 @@ class wf_wrot : public wayfire_plugin_t
     int last_x, last_y;
     wayfire_view current_view;
 
+    const uint32_t transformer_id = wf_get_name_id("wrot");
+
     public:
         void init(wayfire_config *config)
         {
@@ -54,10 +56,10 @@ class wf_wrot : public wayfire_plugin_t
 
             grab_interface->callbacks.pointer.motion = [=] (int x, int y)
             {
-                if (!current_view->get_transformer("wrot"))
-                    current_view->add_transformer(nonstd::make_unique<wf_2D_view> (current_view), "wrot");
+                if (!current_view->get_transformer(transformer_id))
+                    current_view->add_transformer(nonstd::make_unique<wf_2D_view> (current_view), transformer_id);
 
-                auto tr = dynamic_cast<wf_2D_view*> (current_view->get_transformer("wrot").get());
+                auto tr = static_cast<wf_2D_view*> (current_view->get_transformer(transformer_id).get());
                 assert(tr);
 
                 current_view->damage();
@@ -71,10 +73,11 @@ class wf_wrot : public wayfire_plugin_t
                 double x2 = x - cx, y2 = y - cy;
 
                 if (vlen(x2, y2) <= 25)
-                    return current_view->pop_transformer("wrot");
+                    return current_view->pop_transformer(transformer_id);
 
                 /* cross(a, b) = |a| * |b| * sin(a, b) */
-                tr->angle -= std::asin(cross(x1, y1, x2, y2) / vlen(x1, y1) / vlen(x2, y2));
+                tr->set_angle(tr->get_angle() -
+                    std::asin(cross(x1, y1, x2, y2) / vlen(x1, y1) / vlen(x2, y2)));
 
                 current_view->damage();
 
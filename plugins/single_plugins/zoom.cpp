@@ -1,30 +1,32 @@
 #include <plugin.hpp>
 #include <output.hpp>
-#include <opengl.hpp>
 #include <debug.hpp>
 #include <render-manager.hpp>
 #include <animation.hpp>
 
 class wayfire_zoom_screen : public wayfire_plugin_t
 {
-
-    post_hook_t hook;
+    effect_hook_t update_zoom;
+    signal_callback_t pointer_motion;
     axis_callback axis;
 
     wf_option speed, modifier, smoothing_duration;
 
-    GLuint program, posID, uvID;
-
     float target_zoom = 1.0;
-    bool hook_set = false;
+    bool hook_set = false, following_pointer = false;
     wf_duration duration;
 
     public:
         void init(wayfire_config *config)
         {
-            hook = [=] (uint32_t fb, uint32_t tex, uint32_t target)
+            update_zoom = [=] ()
+            {
+                update_animation();
+            };
+
+            pointer_motion = [=] (signal_data*)
             {
-                render(fb, tex, target);
+                apply_zoom();
             };
 
             axis = [=] (wlr_event_pointer_axis* ev)
@@ -57,54 +59,65 @@ class wayfire_zoom_screen : public wayfire_plugin_t
                 auto current = duration.progress();
                 duration.start(current, target_zoom);
 
+                /* we need to repaint on each frame only while animating */
                 if (!hook_set)
                 {
                     hook_set = true;
-                    output->render->add_post(&hook);
+                    output->render->add_effect(&update_zoom, WF_OUTPUT_EFFECT_PRE);
                     output->render->auto_redraw(true);
                 }
+
+                if (!following_pointer)
+                {
+                    following_pointer = true;
+                    output->connect_signal("pointer-motion", &pointer_motion);
+                }
             }
         }
 
-        void render(uint32_t fb, uint32_t tex, uint32_t target)
+        /* Keep the point under the cursor in place. The zoomed screen is
+         * rendered by the render manager, so this only changes the
+         * viewport and damages the output if it actually moved */
+        void apply_zoom()
         {
-            auto w = output->handle->width;
-            auto h = output->handle->height;
             GetTuple(x, y, output->get_cursor_position());
 
-            /* get rotation & scale */
-            wlr_box box = {x, y, 1, 1};
-            box = output_transform_box(output, box);
-
-            x = box.x;
-            y = h - box.y;
-
             const float current_zoom = duration.progress();
             const float scale = (current_zoom - 1) / current_zoom;
 
-            const float tw = w / current_zoom, th = h / current_zoom;
-            const float x1 = x * scale;
-            const float y1 = y * scale;
+            output->render->set_viewport_zoom(current_zoom, x * scale, y * scale);
+        }
 
-            GL_CALL(glBindFramebuffer(GL_READ_FRAMEBUFFER, fb));
-            GL_CALL(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target));
+        void update_animation()
+        {
+            apply_zoom();
+            if (duration.running())
+                return;
 
-            GL_CALL(glBlitFramebuffer(x1, y1, x1 + tw, y1 + th, 0, 0, w, h, GL_COLOR_BUFFER_BIT, GL_LINEAR));
-            GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+            output->render->rem_effect(&update_zoom, WF_OUTPUT_EFFECT_PRE);
+            output->render->auto_redraw(false);
+            hook_set = false;
 
-            if (!duration.running() && current_zoom - 1 <= 0.01)
+            if (duration.progress() - 1 <= 0.01)
             {
-                output->render->auto_redraw(false);
-                output->render->rem_post(&hook);
-                hook_set = false;
+                output->render->set_viewport_zoom(1, 0, 0);
+                output->disconnect_signal("pointer-motion", &pointer_motion);
+                following_pointer = false;
             }
         }
 
         void fini()
         {
             if (hook_set)
-                output->render->rem_post(&hook);
+            {
+                output->render->rem_effect(&update_zoom, WF_OUTPUT_EFFECT_PRE);
+                output->render->auto_redraw(false);
+            }
+
+            if (following_pointer)
+                output->disconnect_signal("pointer-motion", &pointer_motion);
 
+            output->render->set_viewport_zoom(1, 0, 0);
             output->rem_axis(&axis);
         }
 };
@@ -14,14 +14,8 @@
 
 inline wf_tree_node* tile_node_from_view(const wayfire_view& view)
 {
-    auto it = view->custom_data.find(tile_data);
-    if (it == view->custom_data.end())
-        return nullptr;
-
-    auto data = static_cast<wf_tile_view_data*> (it->second);
-    assert(data);
-
-    return data->node;
+    auto data = view->get_data<wf_tile_view_data>();
+    return data ? data->node : nullptr;
 }
 
 namespace wf_tiling
@@ -321,6 +315,8 @@ class wayfire_tile : public wayfire_plugin_t
         if (root.size() != (uint)vw)
             root.resize(vw);
 
+        /* relayout the views of all workspaces in a single transaction */
+        wf_layout_transaction tx;
         for (int i = 0; i < vw; i++)
         {
             if (root[i].size() != (uint) vh)
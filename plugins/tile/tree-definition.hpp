@@ -6,11 +6,10 @@
 #include <view.hpp>
 #include <output.hpp>
 #include <workspace-manager.hpp>
+#include <layout-transaction.hpp>
 #include <debug.hpp>
 #include <assert.h>
 
-#define tile_data "__tile_data"
-
 #define debug_call(msg) log_info("%s : %s at address %p", __func__, msg, this);
 #define debug_scall debug_call("start")
 
@@ -34,7 +33,9 @@ void view_fit_to_box(wayfire_view view, wf_geometry box)
     box.x -= sw * vx;
     box.y -= sh * vy;
     view->set_maximized(true);
-    view->set_geometry(box);
+
+    wf_layout_transaction tx;
+    tx.set_geometry(view, box);
 }
 
 struct wf_tree_node
@@ -59,6 +60,10 @@ struct wf_tree_node
     void recalculate_children_boxes(uint32_t recalculate = RECALC_ALL)
     {
         debug_scall;
+
+        /* all views of the subtree are shown in their new place at once */
+        wf_layout_transaction tx;
+
         size_t size = children.size();
         for (size_t i = 0; i < size; i++)
         {
@@ -158,7 +163,7 @@ struct wf_tree_node
         split_type = child->split_type;
 
         if (view)
-            ((wf_tile_view_data*) view->custom_data[tile_data])->node = this;
+            view->get_data<wf_tile_view_data>()->node = this;
 
         delete child;
 
@@ -196,18 +201,7 @@ struct wf_tree_node
 
         this->view = view;
 
-        auto it = view->custom_data.find(tile_data);
-
-        if (it == view->custom_data.end())
-        {
-            auto cdata = new wf_tile_view_data;
-            cdata->node = this;
-            view->custom_data[tile_data] = cdata;
-        } else
-        {
-            auto data = static_cast<wf_tile_view_data*> (it->second);
-            data->node = this;
-        }
+        view->get_data_safe<wf_tile_view_data>()->node = this;
 
         recalculate_children_boxes();
     }
@@ -217,17 +211,12 @@ struct wf_tree_node
         debug_scall;
         assert(view);
 
-        auto cit = view->custom_data.find(tile_data);
-
-        assert(cit != view->custom_data.end());
-        auto data = static_cast<wf_tile_view_data*> (cit->second);
+        auto data = view->get_data<wf_tile_view_data>();
+        assert(data);
 
         /* if we have moved the view to some other node, we shouldn't free the data */
         if (data->node == this)
-        {
-            delete cit->second;
-            view->custom_data.erase(cit);
-        }
+            view->erase_data<wf_tile_view_data>();
 
         if (reset_view)
             view = nullptr;
@@ -139,6 +139,13 @@ extern "C"
     }
 }
 
+/* the id of our transformer's name, see wf_get_name_id() */
+static uint32_t wobbly_transformer_id()
+{
+    static const uint32_t id = wf_get_name_id("wobbly");
+    return id;
+}
+
 class wf_wobbly : public wf_view_transformer_t
 {
     wayfire_view view;
@@ -233,6 +240,7 @@ class wf_wobbly : public wf_view_transformer_t
         wobbly_prepare_paint(model.get(), 16);
         wobbly_add_geometry(model.get());
         wobbly_done_paint(model.get());
+        dirty = true;
 
         view->damage();
 
@@ -317,11 +325,13 @@ class wf_wobbly : public wf_view_transformer_t
         has_active_grab = 1;
         wobbly_grab_notify(model.get(), x, y);
         unsnap();
+        dirty = true;
     }
 
     void move(int x, int y)
     {
         wobbly_move_notify(model.get(), x - grab_x, y - grab_y);
+        dirty = true;
         grab_x = x;
         grab_y = y;
     }
@@ -331,6 +341,7 @@ class wf_wobbly : public wf_view_transformer_t
         model->width = w;
         model->height = h;
         wobbly_resize_notify(model.get());
+        dirty = true;
     }
 
     void end_grab(bool unanchor)
@@ -338,28 +349,32 @@ class wf_wobbly : public wf_view_transformer_t
         if (has_active_grab && unanchor)
             wobbly_ungrab_notify(model.get());
         has_active_grab = false;
+        dirty = true;
     }
 
     void snap(wf_geometry geometry)
     {
         wobbly_force_geometry(model.get(), geometry.x, geometry.y, geometry.width, geometry.height);
         snapped_geometry = geometry;
+        dirty = true;
     }
 
     void unsnap()
     {
         wobbly_unenforce_geometry(model.get());
         snapped_geometry.width = -1;
+        dirty = true;
     }
 
     void translate(int dx, int dy)
     {
         wobbly_translate(model.get(), dx, dy);
+        dirty = true;
     }
 
     void destroy_self()
     {
-        view->pop_transformer("wobbly");
+        view->pop_transformer(wobbly_transformer_id());
     }
 
     void update_view_geometry(wf_geometry old_geometry)
@@ -412,11 +427,12 @@ class wayfire_wobbly : public wayfire_plugin_t
             if (data->view->get_output() != output)
                 return;
 
+            const auto id = wobbly_transformer_id();
             if ((data->events & (WOBBLY_EVENT_GRAB | WOBBLY_EVENT_SNAP))
-                && data->view->get_transformer("wobbly") == nullptr)
-                data->view->add_transformer(nonstd::make_unique<wf_wobbly> (data->view, grab_interface), "wobbly");
+                && data->view->get_transformer(id) == nullptr)
+                data->view->add_transformer(nonstd::make_unique<wf_wobbly> (data->view, grab_interface), id);
 
-            auto wobbly = dynamic_cast<wf_wobbly*> (data->view->get_transformer("wobbly").get());
+            auto wobbly = static_cast<wf_wobbly*> (data->view->get_transformer(id).get());
             if (!wobbly)
                 return;
 
@@ -444,7 +460,7 @@ class wayfire_wobbly : public wayfire_plugin_t
         {
             output->workspace->for_each_view([] (wayfire_view view)
             {
-                auto wobbly = dynamic_cast<wf_wobbly*> (view->get_transformer("wobbly").get());
+                auto wobbly = static_cast<wf_wobbly*> (view->get_transformer(wobbly_transformer_id()).get());
                 if (wobbly)
                     wobbly->destroy_self();
             }, WF_ALL_LAYERS);
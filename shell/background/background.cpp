@@ -3,32 +3,25 @@
 
 #include "config.hpp"
 #include "window.hpp"
+#include "wallpaper-cache.hpp"
 
-static cairo_surface_t *create_dummy_surface(int w, int h)
+/* shared between all outputs, so that the image is decoded and scaled
+ * only once for each output size */
+static wallpaper_cache cache;
+
+static void render_dummy_background(cairo_surface_t *surface, int w, int h)
 {
-    cairo_surface_t *surf = cairo_image_surface_create(CAIRO_FORMAT_RGB24, w, h);
-    cairo_t *cr = cairo_create(surf);
+    cairo_t *cr = cairo_create(surface);
     cairo_rectangle(cr, 0, 0, w, h);
     cairo_set_source_rgb(cr, 0.1, 0.1, 0.1);
     cairo_fill(cr);
     cairo_destroy(cr);
-
-    return surf;
-}
-
-static cairo_surface_t *create_cairo_surface_from_file(std::string name, int w, int h)
-{
-    auto surface = cairo_try_load_png(name.c_str());
-    return surface ?: create_dummy_surface(w, h);
 }
 
 class wayfire_background
 {
     std::string image;
 
-    cairo_surface_t *img_surface = NULL;
-    cairo_t *cr = NULL;
-
     wayfire_output *output;
     wayfire_window *window = nullptr;
 
@@ -48,9 +41,6 @@ class wayfire_background
 
     void resize(int w, int h)
     {
-        if (!img_surface)
-            img_surface = create_cairo_surface_from_file(image, w, h);
-
         if (window)
         {
             /* the first inhibit was called in the constructor
@@ -77,15 +67,8 @@ class wayfire_background
         window->pointer_enter = std::bind(std::mem_fn(&wayfire_background::on_enter),
                                           this, _1, _2, _3, _4);
 
-        cr = cairo_create(window->cairo_surface);
-
-        double img_w = cairo_image_surface_get_width(img_surface);
-        double img_h = cairo_image_surface_get_height(img_surface);
-
-        cairo_rectangle(cr, 0, 0, width, height);
-        cairo_scale(cr, width / img_w, height / img_h);
-        cairo_set_source_surface(cr, img_surface, 0, 0);
-        cairo_fill(cr);
+        if (!cache.render(image, window->cairo_surface))
+            render_dummy_background(window->cairo_surface, width, height);
 
         window->damage_commit();
         zwf_output_v1_inhibit_output_done(output->zwf);
@@ -99,11 +82,7 @@ class wayfire_background
     ~wayfire_background()
     {
         if (window)
-        {
-            cairo_destroy(cr);
             delete window;
-            cairo_surface_destroy(img_surface);
-        }
     }
 };
 
@@ -0,0 +1,318 @@
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <algorithm>
+#include <functional>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "window.hpp"
+#include "wallpaper-cache.hpp"
+
+/* on-disk layout: header, the image path, padding up to pixel_offset, pixels */
+struct cache_file_header
+{
+    char magic[8];
+    int32_t width, height, stride;
+    uint32_t path_length;
+    int64_t mtime_sec, mtime_nsec;
+    uint64_t pixel_offset;
+};
+
+static const char cache_magic[8] = {'W', 'F', 'B', 'G', 'C', 'A', '0', '1'};
+static const uint64_t pixel_alignment = 64;
+
+wallpaper_variant::~wallpaper_variant()
+{
+    if (map)
+        munmap(map, map_size);
+}
+
+static bool mkdir_recursive(std::string path)
+{
+    for (size_t i = 1; i <= path.size(); i++)
+    {
+        if (i < path.size() && path[i] != '/')
+            continue;
+
+        auto dir = path.substr(0, i);
+        if (mkdir(dir.c_str(), 0700) < 0 && errno != EEXIST)
+            return false;
+    }
+
+    return true;
+}
+
+wallpaper_cache::wallpaper_cache()
+{
+    const char *xdg_cache = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+
+    if (xdg_cache && *xdg_cache)
+        cache_dir = xdg_cache;
+    else if (home)
+        cache_dir = std::string(home) + "/.cache";
+
+    if (!cache_dir.empty())
+    {
+        cache_dir += "/wayfire/background";
+        if (!mkdir_recursive(cache_dir))
+        {
+            std::cerr << "background: cannot create cache directory "
+                << cache_dir << ", wallpaper won't be cached" << std::endl;
+            cache_dir.clear();
+        }
+    }
+}
+
+wallpaper_cache::~wallpaper_cache()
+{
+    variants.clear();
+    if (source)
+        cairo_surface_destroy(source);
+}
+
+cairo_surface_t *wallpaper_cache::get_source(const std::string& path,
+                                             int64_t mtime_sec, int64_t mtime_nsec)
+{
+    if (source && source_path == path && source_mtime_sec == mtime_sec &&
+        source_mtime_nsec == mtime_nsec)
+    {
+        return source;
+    }
+
+    if (source)
+        cairo_surface_destroy(source);
+
+    source = cairo_try_load_png(path.c_str());
+    if (source && cairo_surface_status(source) != CAIRO_STATUS_SUCCESS)
+    {
+        cairo_surface_destroy(source);
+        source = nullptr;
+    }
+
+    source_path = path;
+    source_mtime_sec = mtime_sec;
+    source_mtime_nsec = mtime_nsec;
+    return source;
+}
+
+std::string wallpaper_cache::get_cache_file(const key_t& key)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/%016zx-%dx%d.bin",
+             std::hash<std::string>()(std::get<0>(key)),
+             std::get<1>(key), std::get<2>(key));
+
+    return cache_dir + name;
+}
+
+std::shared_ptr<wallpaper_variant> wallpaper_cache::load_variant(const key_t& key)
+{
+    if (cache_dir.empty())
+        return nullptr;
+
+    int fd = open(get_cache_file(key).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(cache_file_header))
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    auto map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+        return nullptr;
+
+    auto variant = std::make_shared<wallpaper_variant>();
+    variant->map = map;
+    variant->map_size = st.st_size;
+
+    const auto& path = std::get<0>(key);
+    auto header = (const cache_file_header*) map;
+
+    int expected_stride =
+        cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, std::get<1>(key));
+
+    /* anything that doesn't match exactly is a stale or foreign entry,
+     * it will be overwritten by create_variant() */
+    if (memcmp(header->magic, cache_magic, sizeof(cache_magic)) ||
+        header->width != std::get<1>(key) ||
+        header->height != std::get<2>(key) ||
+        header->stride != expected_stride ||
+        header->mtime_sec != std::get<3>(key) ||
+        header->mtime_nsec != std::get<4>(key) ||
+        header->path_length != path.size() ||
+        sizeof(cache_file_header) + path.size() > header->pixel_offset ||
+        header->pixel_offset + (uint64_t)header->stride * header->height > variant->map_size ||
+        memcmp((const char*)map + sizeof(cache_file_header), path.data(), path.size()))
+    {
+        return nullptr;
+    }
+
+    variant->pixels = (unsigned char*) map + header->pixel_offset;
+    variant->width = header->width;
+    variant->height = header->height;
+    variant->stride = header->stride;
+
+    return variant;
+}
+
+static bool write_all(int fd, const void *data, size_t size)
+{
+    auto ptr = (const char*) data;
+    while (size > 0)
+    {
+        ssize_t written = write(fd, ptr, size);
+        if (written < 0 && errno == EINTR)
+            continue;
+
+        if (written <= 0)
+            return false;
+
+        ptr += written;
+        size -= written;
+    }
+
+    return true;
+}
+
+std::shared_ptr<wallpaper_variant> wallpaper_cache::create_variant(const key_t& key)
+{
+    const auto& path = std::get<0>(key);
+    int width = std::get<1>(key), height = std::get<2>(key);
+
+    auto img = get_source(path, std::get<3>(key), std::get<4>(key));
+    if (!img)
+        return nullptr;
+
+    auto scaled = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+    auto cr = cairo_create(scaled);
+
+    double img_w = cairo_image_surface_get_width(img);
+    double img_h = cairo_image_surface_get_height(img);
+
+    cairo_rectangle(cr, 0, 0, width, height);
+    cairo_scale(cr, width / img_w, height / img_h);
+    cairo_set_source_surface(cr, img, 0, 0);
+    cairo_fill(cr);
+    cairo_destroy(cr);
+    cairo_surface_flush(scaled);
+
+    cache_file_header header;
+    memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.width = width;
+    header.height = height;
+    header.stride = cairo_image_surface_get_stride(scaled);
+    header.path_length = path.size();
+    header.mtime_sec = std::get<3>(key);
+    header.mtime_nsec = std::get<4>(key);
+
+    uint64_t pixel_offset = sizeof(header) + path.size();
+    pixel_offset = (pixel_offset + pixel_alignment - 1) / pixel_alignment * pixel_alignment;
+    header.pixel_offset = pixel_offset;
+
+    /* write to a temporary file and rename it, so that other instances never
+     * see a partially written entry */
+    bool stored = false;
+    auto file = get_cache_file(key);
+    auto tmp_file = file + ".XXXXXX";
+
+    int fd = cache_dir.empty() ? -1 : mkstemp(&tmp_file[0]);
+    if (fd >= 0)
+    {
+        std::string padding(pixel_offset - sizeof(header) - path.size(), '\0');
+        size_t pixels_size = (size_t)header.stride * height;
+
+        stored = write_all(fd, &header, sizeof(header)) &&
+            write_all(fd, path.data(), path.size()) &&
+            write_all(fd, padding.data(), padding.size()) &&
+            write_all(fd, cairo_image_surface_get_data(scaled), pixels_size);
+
+        close(fd);
+        stored = stored && rename(tmp_file.c_str(), file.c_str()) == 0;
+
+        if (!stored)
+            unlink(tmp_file.c_str());
+    }
+
+    std::shared_ptr<wallpaper_variant> variant;
+    if (stored)
+        variant = load_variant(key);
+
+    if (!variant)
+    {
+        /* cache directory isn't usable, keep an anonymous copy in memory so
+         * that we still don't rescale for each output */
+        size_t size = (size_t)header.stride * height;
+        auto map = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (map == MAP_FAILED)
+        {
+            cairo_surface_destroy(scaled);
+            return nullptr;
+        }
+
+        memcpy(map, cairo_image_surface_get_data(scaled), size);
+
+        variant = std::make_shared<wallpaper_variant>();
+        variant->map = map;
+        variant->map_size = size;
+        variant->pixels = (unsigned char*) map;
+        variant->width = width;
+        variant->height = height;
+        variant->stride = header.stride;
+    }
+
+    cairo_surface_destroy(scaled);
+    return variant;
+}
+
+bool wallpaper_cache::render(const std::string& path, cairo_surface_t *target)
+{
+    struct stat st;
+    if (path.empty() || stat(path.c_str(), &st) < 0)
+        return false;
+
+    int width = cairo_image_surface_get_width(target);
+    int height = cairo_image_surface_get_height(target);
+
+    key_t key{path, width, height, (int64_t)st.st_mtim.tv_sec,
+        (int64_t)st.st_mtim.tv_nsec};
+
+    auto& variant = variants[key];
+    if (!variant)
+        variant = load_variant(key);
+    if (!variant)
+        variant = create_variant(key);
+
+    if (!variant)
+    {
+        variants.erase(key);
+        return false;
+    }
+
+    cairo_surface_flush(target);
+
+    auto dst = cairo_image_surface_get_data(target);
+    int dst_stride = cairo_image_surface_get_stride(target);
+    size_t row_size = std::min(dst_stride, variant->stride);
+
+    for (int y = 0; y < height; y++)
+    {
+        memcpy(dst + (size_t)y * dst_stride,
+               variant->pixels + (size_t)y * variant->stride, row_size);
+    }
+
+    cairo_surface_mark_dirty(target);
+    return true;
+}
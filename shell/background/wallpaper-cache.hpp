@@ -0,0 +1,56 @@
+#ifndef WALLPAPER_CACHE_HPP
+#define WALLPAPER_CACHE_HPP
+
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <cairo.h>
+
+/* A scaled copy of the wallpaper, mmap()-ed from the on-disk cache */
+struct wallpaper_variant
+{
+    void *map = nullptr;
+    size_t map_size = 0;
+
+    unsigned char *pixels = nullptr;
+    int width, height, stride;
+
+    ~wallpaper_variant();
+};
+
+/* Caches the wallpaper scaled to each output size the background has seen.
+ *
+ * The source image is decoded at most once per (path, mtime), every scaled
+ * variant is stored under $XDG_CACHE_HOME/wayfire/background and reused
+ * across outputs and restarts, so that a cache hit is just a copy from the
+ * mapped file into the window's shm buffer */
+class wallpaper_cache
+{
+    using key_t = std::tuple<std::string, int, int, int64_t, int64_t>;
+    std::map<key_t, std::shared_ptr<wallpaper_variant>> variants;
+
+    std::string source_path;
+    int64_t source_mtime_sec = -1, source_mtime_nsec = -1;
+    cairo_surface_t *source = nullptr;
+
+    std::string cache_dir;
+
+    cairo_surface_t *get_source(const std::string& path,
+                                int64_t mtime_sec, int64_t mtime_nsec);
+    std::string get_cache_file(const key_t& key);
+
+    std::shared_ptr<wallpaper_variant> load_variant(const key_t& key);
+    std::shared_ptr<wallpaper_variant> create_variant(const key_t& key);
+
+    public:
+    wallpaper_cache();
+    ~wallpaper_cache();
+
+    /* Fill target, which must be an ARGB32 image surface, with the image at
+     * path scaled to the size of target. Returns false if the image
+     * can't be loaded, in which case target is left untouched */
+    bool render(const std::string& path, cairo_surface_t *target);
+};
+
+#endif /* end of include guard: WALLPAPER_CACHE_HPP */
@@ -1,4 +1,5 @@
 #include <sstream>
+#include <algorithm>
 #include <unistd.h>
 #include <sys/time.h>
 #include <linux/input-event-codes.h>
@@ -169,6 +170,36 @@ void wayfire_panel::position_widgets()
     clock->x = width - clock->get_width() - widget_spacing;
 }
 
+/* repaint only the area covered by the widget now and on its last repaint,
+ * so that e.g a clock tick doesn't upload the whole panel */
+void wayfire_panel::repaint_widget(widget *w)
+{
+    /* launchers grow a bit when hovered, so leave some room on the sides */
+    int margin = widget::font_size * 0.5;
+
+    int x1 = std::min(w->x, w->last_x) - margin;
+    int x2 = std::max(w->x + w->width, w->last_x + w->last_width) + margin;
+
+    cairo_save(cr);
+    cairo_rectangle(cr, x1, 0, x2 - x1, height);
+    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+    cairo_set_source_rgba(cr, widget::background_color.r, widget::background_color.g,
+                          widget::background_color.b, widget::background_color.a);
+    cairo_fill(cr);
+    cairo_restore(cr);
+
+    cairo_save(w->cr);
+    cairo_reset_clip(w->cr);
+    cairo_rectangle(w->cr, x1, 0, x2 - x1, height);
+    cairo_clip(w->cr);
+    w->repaint();
+    cairo_restore(w->cr);
+
+    window->damage(x1, 0, x2 - x1, height);
+    w->last_x = w->x;
+    w->last_width = w->width;
+}
+
 void wayfire_panel::set_autohide(bool ah)
 {
     autohide += ah ? 1 : -1;
@@ -314,16 +345,17 @@ void wayfire_panel::render_frame(bool first_call)
         zwf_wm_surface_v1_configure(window->zwf, 0, animation.y);
     }
 
-    bool should_swap = first_call;
+    bool launchers_changed = false, clock_changed = false;
     if (animation.target == 0 || !autohide)
     {
-        should_swap |= launchers->update();
-        should_swap |= clock->update();
+        launchers_changed = launchers->update();
+        clock_changed = clock->update();
     }
 
-    should_swap = should_swap || need_fullredraw;
+    bool full_redraw = first_call || need_fullredraw;
+    bool should_swap = full_redraw || launchers_changed || clock_changed;
 
-    if (should_swap)
+    if (full_redraw)
     {
         cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
         render_rounded_rectangle(cr, 0, 0, width, height,
@@ -334,6 +366,20 @@ void wayfire_panel::render_frame(bool first_call)
         position_widgets();
         launchers->repaint();
         clock->repaint();
+
+        window->damage(0, 0, width, height);
+        launchers->last_x = launchers->x;
+        launchers->last_width = launchers->width;
+        clock->last_x = clock->x;
+        clock->last_width = clock->width;
+    }
+    else if (should_swap)
+    {
+        position_widgets();
+        if (launchers_changed)
+            repaint_widget(launchers.get());
+        if (clock_changed)
+            repaint_widget(clock.get());
     }
 
     /* we don't need to redraw only if we are autohiding and hidden now */
@@ -55,6 +55,7 @@ class wayfire_panel
     std::unique_ptr<launchers_widget> launchers;
 
     void position_widgets();
+    void repaint_widget(widget *w);
     void init_widgets();
 
     void init(int32_t width, int32_t height);
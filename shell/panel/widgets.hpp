@@ -18,6 +18,9 @@ struct widget
     /* leftmost position in panel, panel height, maximum width */
     int x, panel_h, width = 0;
 
+    /* position and width at the last repaint, used to clear the old area */
+    int last_x = 0, last_width = 0;
+
 
     /* only panel_h is visible, the widget still hasn't been positioned */
     virtual void create() = 0;
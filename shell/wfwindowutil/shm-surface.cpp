@@ -13,6 +13,8 @@
 #include <wayland-client-protocol.h>
 
 #include <cairo.h>
+#include <memory>
+#include <vector>
 
 #include "config.h"
 #include "window.hpp"
@@ -25,18 +27,51 @@ struct rectangle
 	int height;
 };
 
+/* the window can have at most this many buffers in flight, if all of them
+ * are held by the compositor, the commit is delayed until one is released */
+#define MAX_SHM_BUFFERS 3
+
 struct shm_pool
 {
 	wl_shm_pool *pool;
+	int fd;
 	size_t size;
 	size_t used;
 	void *data;
 };
 
-struct shm_surface_data
+struct shm_surface_data;
+struct shm_buffer
 {
 	wl_buffer *buffer;
+	size_t offset;
+
+	/* the compositor may still read from the buffer until it is released */
+	bool busy = false;
+
+	/* area where the buffer contents differ from the window's cairo surface */
+	cairo_region_t *stale;
+	shm_surface_data *owner;
+};
+
+/* The window draws into a private image surface, which is copied to a free
+ * shm buffer on each commit. Only the region which changed since the buffer
+ * was last used is copied, and only the damage since the last commit is
+ * sent to the compositor */
+struct shm_surface_data
+{
+	wl_surface *surface;
+	bool use_damage_buffer;
+
 	shm_pool *pool;
+	std::vector<std::unique_ptr<shm_buffer>> buffers;
+
+	rectangle rect;
+	int stride;
+
+	cairo_surface_t *back;
+	cairo_region_t *damage;
+	bool pending_commit = false;
 };
 
 struct shm_window : wayfire_window
@@ -46,12 +81,10 @@ struct shm_window : wayfire_window
 
 const cairo_user_data_key_t shm_surface_data_key = {0};
 
- wl_buffer* get_buffer_from_cairo_surface(cairo_surface_t *surface)
+shm_surface_data* get_shm_surface_data(cairo_surface_t *surface)
 {
-	auto data = static_cast<shm_surface_data*>
+	return static_cast<shm_surface_data*>
         (cairo_surface_get_user_data(surface, &shm_surface_data_key));
-
-	return data->buffer;
 }
 
 void shm_pool_destroy(shm_pool *pool);
@@ -59,7 +92,15 @@ void shm_pool_destroy(shm_pool *pool);
 void shm_surface_data_destroy(void *p)
 {
 	auto data = static_cast<shm_surface_data*> (p);
-	wl_buffer_destroy(data->buffer);
+	for (auto& buffer : data->buffers)
+	{
+		wl_buffer_destroy(buffer->buffer);
+		cairo_region_destroy(buffer->stale);
+	}
+
+	data->buffers.clear();
+	cairo_region_destroy(data->damage);
+
 	if (data->pool)
 		shm_pool_destroy(data->pool);
 
@@ -137,49 +178,60 @@ int os_create_anonymous_file(off_t size)
 	return fd;
 }
 
-
-wl_shm_pool* make_shm_pool(wl_shm *shm, int size, void **data)
+shm_pool * shm_pool_create( wl_shm *shm, size_t size)
 {
-    wl_shm_pool *pool;
-    int fd;
+    auto pool = new shm_pool;
 
-    fd = os_create_anonymous_file(size);
-    if (fd < 0) {
+    pool->fd = os_create_anonymous_file(size);
+    if (pool->fd < 0) {
         std::cerr << "creating a buffer file for " << size << " failed" << std::endl;
+        delete pool;
         return NULL;
     }
 
-    *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if (*data == MAP_FAILED) {
+    pool->data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, pool->fd, 0);
+    if (pool->data == MAP_FAILED) {
         std::cerr << "mmap failed" << std::endl;
-        close(fd);
+        close(pool->fd);
+        delete pool;
         return NULL;
     }
 
-    pool = wl_shm_create_pool(shm, fd, size);
-
-    close(fd);
+    pool->pool = wl_shm_create_pool(shm, pool->fd, size);
+    pool->size = size;
+    pool->used = 0;
 
     return pool;
 }
 
-shm_pool * shm_pool_create( wl_shm *shm, size_t size)
+/* grow the pool so that it has room for at least size more bytes.
+ * Existing buffers stay valid, but pool->data may move */
+static bool shm_pool_grow(shm_pool *pool, size_t size)
 {
-    auto pool = new shm_pool;
+    size_t new_size = pool->used + size;
+    if (new_size <= pool->size)
+        return true;
 
-    if (!pool)
-        return NULL;
+    int ret = posix_fallocate(pool->fd, 0, new_size);
+    if (ret != 0)
+    {
+        std::cerr << "failed to grow shm pool to " << new_size << std::endl;
+        return false;
+    }
 
-    pool->pool = make_shm_pool(shm, size, &pool->data);
-    if (!pool->pool) {
-        delete pool;
-        return NULL;
+    void *data = mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, pool->fd, 0);
+    if (data == MAP_FAILED)
+    {
+        std::cerr << "mmap failed" << std::endl;
+        return false;
     }
 
-    pool->size = size;
-    pool->used = 0;
+    munmap(pool->data, pool->size);
+    pool->data = data;
+    pool->size = new_size;
+    wl_shm_pool_resize(pool->pool, new_size);
 
-    return pool;
+    return true;
 }
 
     static void *
@@ -194,11 +246,12 @@ shm_pool_allocate( shm_pool *pool, size_t size, int *offset)
     return (char *) pool->data + *offset;
 }
 
-/* destroy the pool. this does not unmap the memory though */
+/* destroy the pool, unmapping its memory */
 void shm_pool_destroy( shm_pool *pool)
 {
     munmap(pool->data, pool->size);
     wl_shm_pool_destroy(pool->pool);
+    close(pool->fd);
     delete pool;
 }
 
@@ -209,41 +262,154 @@ inline int data_length_for_shm_surface(rectangle *rect)
     return cairo_format_stride_for_width(target_fmt, rect->width) * rect->height;
 }
 
-cairo_surface_t * create_shm_surface_from_pool(void *none, rectangle *rectangle, shm_pool *pool)
+static void shm_surface_commit(shm_surface_data *data, shm_buffer *buffer);
+
+static void buffer_handle_release(void *user_data, wl_buffer *)
+{
+    auto buffer = static_cast<shm_buffer*> (user_data);
+    buffer->busy = false;
+
+    auto data = buffer->owner;
+    if (data->pending_commit)
+    {
+        data->pending_commit = false;
+        shm_surface_commit(data, buffer);
+    }
+}
+
+static const struct wl_buffer_listener buffer_listener = {
+    buffer_handle_release
+};
+
+static shm_buffer *shm_surface_add_buffer(shm_surface_data *data)
 {
-    cairo_surface_t *surface;
+    size_t length = data->stride * data->rect.height;
+    if (!shm_pool_grow(data->pool, length))
+        return NULL;
 
-    auto data = new shm_surface_data;
-    if (data == NULL)
+    int offset;
+    if (!shm_pool_allocate(data->pool, length, &offset))
         return NULL;
 
-    int stride = cairo_format_stride_for_width (target_fmt, rectangle->width);
-    int length = stride * rectangle->height;
-    data->pool = NULL;
+    auto buffer = new shm_buffer;
+    buffer->offset = offset;
+    buffer->owner = data;
+    cairo_rectangle_int_t full = {0, 0, data->rect.width, data->rect.height};
+    buffer->stale = cairo_region_create_rectangle(&full);
+    buffer->buffer = wl_shm_pool_create_buffer(data->pool->pool, offset,
+            data->rect.width, data->rect.height,
+            data->stride, WL_SHM_FORMAT_ARGB8888);
+    wl_buffer_add_listener(buffer->buffer, &buffer_listener, buffer);
+
+    data->buffers.push_back(std::unique_ptr<shm_buffer> (buffer));
+    return buffer;
+}
 
-    int offset;
-    void *map = shm_pool_allocate(pool, length, &offset);
+static shm_buffer *shm_surface_get_free_buffer(shm_surface_data *data)
+{
+    for (auto& buffer : data->buffers)
+    {
+        if (!buffer->busy)
+            return buffer.get();
+    }
+
+    if (data->buffers.size() < MAX_SHM_BUFFERS)
+        return shm_surface_add_buffer(data);
+
+    return NULL;
+}
+
+/* bring the buffer up to date with the window contents and commit it
+ * with the damage accumulated since the last commit */
+static void shm_surface_commit(shm_surface_data *data, shm_buffer *buffer)
+{
+    for (auto& buf : data->buffers)
+        cairo_region_union(buf->stale, data->damage);
+
+    cairo_surface_flush(data->back);
+    auto src = cairo_image_surface_get_data(data->back);
+    auto dst = (unsigned char*) data->pool->data + buffer->offset;
+
+    int n = cairo_region_num_rectangles(buffer->stale);
+    for (int i = 0; i < n; i++)
+    {
+        cairo_rectangle_int_t box;
+        cairo_region_get_rectangle(buffer->stale, i, &box);
+
+        size_t start = box.x * 4;
+        size_t length = box.width * 4;
+        for (int y = box.y; y < box.y + box.height; y++)
+        {
+            size_t row = (size_t)y * data->stride;
+            memcpy(dst + row + start, src + row + start, length);
+        }
+    }
+
+    cairo_region_destroy(buffer->stale);
+    buffer->stale = cairo_region_create();
+
+    wl_surface_attach(data->surface, buffer->buffer, 0, 0);
+
+    n = cairo_region_num_rectangles(data->damage);
+    for (int i = 0; i < n; i++)
+    {
+        cairo_rectangle_int_t box;
+        cairo_region_get_rectangle(data->damage, i, &box);
+
+        /* the windows are never scaled or transformed, so both are the same,
+         * except that damage_buffer needs wl_compositor v4 */
+        if (data->use_damage_buffer)
+            wl_surface_damage_buffer(data->surface, box.x, box.y, box.width, box.height);
+        else
+            wl_surface_damage(data->surface, box.x, box.y, box.width, box.height);
+    }
+
+    cairo_region_destroy(data->damage);
+    data->damage = cairo_region_create();
+
+    buffer->busy = true;
+    wl_surface_commit(data->surface);
+}
+
+cairo_surface_t * create_shm_surface(wayfire_display *display,
+                                     wl_surface *wl_surface, rectangle *rectangle)
+{
+    auto data = new shm_surface_data;
+
+    data->surface = wl_surface;
+    data->use_damage_buffer = display->compositor_version >=
+        WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION;
+
+    data->rect = *rectangle;
+    data->stride = cairo_format_stride_for_width (target_fmt, rectangle->width);
+
+    data->pool = shm_pool_create(display->shm, data_length_for_shm_surface(rectangle));
+    if (!data->pool)
+    {
+        std::cerr << "failed to init shm_pool" << std::endl;
+        delete data;
+        return NULL;
+    }
+
+    data->back = cairo_image_surface_create(target_fmt,
+            rectangle->width, rectangle->height);
 
-    if (!map) {
+    if (cairo_surface_status(data->back) != CAIRO_STATUS_SUCCESS ||
+        cairo_image_surface_get_stride(data->back) != data->stride)
+    {
+        cairo_surface_destroy(data->back);
+        shm_pool_destroy(data->pool);
         delete data;
         return NULL;
     }
 
-    surface = cairo_image_surface_create_for_data ((unsigned char*) map,
-            target_fmt,
-            rectangle->width,
-            rectangle->height,
-            stride);
+    data->damage = cairo_region_create();
+    shm_surface_add_buffer(data);
 
-    cairo_surface_set_user_data(surface, &shm_surface_data_key,
+    cairo_surface_set_user_data(data->back, &shm_surface_data_key,
             data, shm_surface_data_destroy);
 
-    data->buffer = wl_shm_pool_create_buffer(pool->pool, offset,
-            rectangle->width,
-            rectangle->height,
-            stride, WL_SHM_FORMAT_ARGB8888);
-
-    return surface;
+    return data->back;
 }
 
 static void xdg_surface_handle_configure(void *data,
@@ -282,9 +448,6 @@ wayfire_window* create_shm_window(wayfire_display *display,
                                   uint32_t w, uint32_t h,
                                   std::function<void()> conf)
 {
-    shm_surface_data *data;
-    shm_pool *pool;
-
     shm_window *window = new shm_window;
 
     window->rect.x = 0;
@@ -302,38 +465,49 @@ wayfire_window* create_shm_window(wayfire_display *display,
     zxdg_toplevel_v6_add_listener(window->toplevel, &xdg_toplevel_listener, NULL);
     wl_surface_commit(window->surface);
 
-    pool = shm_pool_create(display->shm, data_length_for_shm_surface(&window->rect));
-    if (!pool)
-    {
-        std::cerr << "failed to init shm_pool" << std::endl;
-        return NULL;
-    }
-
-    window->cairo_surface =
-        create_shm_surface_from_pool(display->shm, &window->rect, pool);
+    /* the shm buffers are destroyed together with the cairo surface */
+    window->cairo_surface = create_shm_surface(display, window->surface, &window->rect);
 
     if (!window->cairo_surface)
     {
         std::cerr << "failed to create a cairo surface" << std::endl;
-        shm_pool_destroy(pool);
         return NULL;
     }
 
-    /* make sure we destroy the pool when the surface is destroyed */
-    data = (shm_surface_data*) cairo_surface_get_user_data(window->cairo_surface, &shm_surface_data_key);
-    data->pool = pool;
-
     return window;
 }
 
+void wayfire_window::damage(int x, int y, int width, int height)
+{
+    auto data = get_shm_surface_data(cairo_surface);
+
+    cairo_rectangle_int_t box = {x, y, width, height};
+    cairo_rectangle_int_t full = {0, 0, data->rect.width, data->rect.height};
+
+    cairo_region_t *region = cairo_region_create_rectangle(&box);
+    cairo_region_intersect_rectangle(region, &full);
+    cairo_region_union(data->damage, region);
+    cairo_region_destroy(region);
+}
+
 void wayfire_window::damage_commit()
 {
-    auto window = static_cast<shm_window*> (this);
+    auto data = get_shm_surface_data(cairo_surface);
 
-    wl_surface_attach(window->surface, get_buffer_from_cairo_surface(window->cairo_surface),0,0);
-    wl_surface_damage(window->surface, window->rect.x,
-            window->rect.y,
-            window->rect.width,
-            window->rect.height);
-    wl_surface_commit(window->surface);
+    /* nothing was damaged explicitly, assume the whole window changed */
+    if (cairo_region_is_empty(data->damage))
+        damage(0, 0, data->rect.width, data->rect.height);
+
+    /* all buffers are busy, commit when the compositor releases one of them */
+    if (data->pending_commit)
+        return;
+
+    auto buffer = shm_surface_get_free_buffer(data);
+    if (!buffer)
+    {
+        data->pending_commit = true;
+        return;
+    }
+
+    shm_surface_commit(data, buffer);
 }
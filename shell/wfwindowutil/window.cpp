@@ -99,9 +99,10 @@ void registry_add_object(void *data, struct wl_registry *registry, uint32_t name
 
     if (strcmp(interface, wl_compositor_interface.name) == 0)
     {
+        display->compositor_version = std::min(version, 4u);
         display->compositor = (wl_compositor*) wl_registry_bind(registry, name,
                                                                 &wl_compositor_interface,
-                                                                std::min(version, 3u));
+                                                                display->compositor_version);
     }
     else if (strcmp(interface, zxdg_shell_v6_interface.name) == 0)
     {
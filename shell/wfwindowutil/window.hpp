@@ -17,6 +17,7 @@ struct wl_cursor;
 struct wayfire_display
 {
     wl_compositor *compositor = nullptr;
+    uint32_t compositor_version = 0;
     wl_display    *display = nullptr;
     wl_shm        *shm = nullptr;
 
@@ -88,6 +89,12 @@ struct wayfire_window
     wayfire_window();
     ~wayfire_window();
 
+    /* mark a rectangle of cairo_surface as changed since the last commit */
+    void damage(int x, int y, int width, int height);
+
+    /* commit the damaged area, or the whole window if nothing was damaged
+     * explicitly. If the compositor still holds all buffers, the commit
+     * happens as soon as one of them is released */
     void damage_commit();
 };
 
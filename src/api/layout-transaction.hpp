@@ -0,0 +1,43 @@
+#ifndef LAYOUT_TRANSACTION_HPP
+#define LAYOUT_TRANSACTION_HPP
+
+#include <view.hpp>
+
+/* Changes the geometry of several views so that they appear in their new
+ * place in the same frame, for ex. when a tiling layout is recalculated.
+ *
+ * When the transaction is committed, the views are sent their new sizes
+ * right away, but they keep showing their old contents at the old geometry
+ * until every client has committed a buffer with its new size (or the
+ * timeout from [core] transaction_timeout has expired). Then all of them are
+ * shown in their new place at once.
+ *
+ * Transactions nest: a transaction started while another one is open becomes
+ * part of it, and everything is committed when the outermost one goes out of
+ * scope. So code which positions views recursively can simply open a
+ * transaction at each level:
+ *
+ *     {
+ *         wf_layout_transaction tx;
+ *         tx.set_geometry(left, left_box);
+ *         tx.set_geometry(right, right_box);
+ *     } // committed here */
+class wf_layout_transaction
+{
+    public:
+        wf_layout_transaction();
+        ~wf_layout_transaction();
+
+        wf_layout_transaction(const wf_layout_transaction&) = delete;
+        wf_layout_transaction& operator = (const wf_layout_transaction&) = delete;
+
+        /* the same as view->set_geometry(), but applied with the rest of the
+         * transaction. The last geometry set for a view wins */
+        void set_geometry(wayfire_view view, wf_geometry geometry);
+};
+
+/* NOT API, used by frozen views to tell the transaction about their state */
+void wf_layout_transaction_view_committed(wayfire_view_t *view);
+void wf_layout_transaction_view_unmapped(wayfire_view_t *view);
+
+#endif /* end of include guard: LAYOUT_TRANSACTION_HPP */
@@ -12,6 +12,7 @@ extern "C"
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include <map>
+#include <functional>
 
 class wayfire_output;
 using wf_geometry = wlr_box;
@@ -44,6 +45,11 @@ struct wf_framebuffer
     wf_geometry geometry = {0, 0, 0, 0};
     glm::mat4 transform = glm::mat4(1.0);
 
+    /* magnification of the contents, used when rendering the zoomed screen.
+     * It is already part of transform, but surfaces rendered with wlroots'
+     * matrices need it separately */
+    float zoom = 1.0;
+
     uint32_t viewport_width, viewport_height;
 
     void init();
@@ -54,6 +60,30 @@ struct wf_framebuffer
     void release();
 };
 
+/* what the GPU memory of render targets is used for */
+enum wf_gpu_memory_category
+{
+    WF_GPU_MEMORY_WORKSPACE_STREAM = 0,
+    WF_GPU_MEMORY_SNAPSHOT         = 1,
+    WF_GPU_MEMORY_TRANSFORM        = 2,
+    WF_GPU_MEMORY_POST_EFFECT      = 3,
+    WF_GPU_MEMORY_OTHER            = 4,
+    WF_GPU_MEMORY_CATEGORY_TOTAL   = 5
+};
+
+struct wf_gpu_memory_stats
+{
+    /* render targets in use, per category */
+    size_t bytes[WF_GPU_MEMORY_CATEGORY_TOTAL] = {0};
+    int targets[WF_GPU_MEMORY_CATEGORY_TOTAL] = {0};
+
+    /* released targets, kept for reuse */
+    size_t pool_bytes = 0;
+    int pool_targets = 0;
+
+    uint64_t allocations = 0, pool_hits = 0, evictions = 0;
+};
+
 namespace OpenGL
 {
     /* Different Context is kept for each output */
@@ -88,6 +118,13 @@ namespace OpenGL
     void render_texture(GLuint tex, const gl_geometry& g,
                         const gl_geometry& texg, uint32_t bits);
 
+    /* render many quads from the same texture with a single draw call.
+     * vertices and uv hold 6 (x, y) pairs (two triangles) per quad */
+    void render_textured_quads(GLuint tex, const GLfloat *vertices,
+                               const GLfloat *uv, int quad_count,
+                               glm::mat4 transform = glm::mat4(1.0),
+                               glm::vec4 color = glm::vec4(1.f));
+
     GLuint duplicate_texture(GLuint source_tex, int w, int h);
 
     GLuint load_shader(const char *path, GLuint type);
@@ -100,6 +137,27 @@ namespace OpenGL
                                   GLuint& fbuff, GLuint& texture,
                                   float scale_x = 1, float scale_y = 1);
 
+    /* Render targets (a framebuffer with a w x h RGBA texture) which are
+     * accounted against the [core] gpu_memory_budget (in MiB, 0 means
+     * unlimited). Released targets are kept in a pool and reused for the
+     * next target of the same size, so their contents are undefined.
+     *
+     * If evict is set, the target may be taken away when the budget is
+     * exceeded and it hasn't been used for a while: evict() must then
+     * release it, or return false if it can't do that now. The owner
+     * allocates a new target the next time it needs one */
+    void allocate_render_target(int w, int h, GLuint& fbuff, GLuint& texture,
+                                wf_gpu_memory_category category,
+                                std::function<bool()> evict = nullptr);
+    /* fbuff and texture are set to -1 */
+    void release_render_target(GLuint& fbuff, GLuint& texture);
+    /* the target was used, evict it after the ones which weren't */
+    void touch_render_target(GLuint fbuff);
+
+    const wf_gpu_memory_stats& get_gpu_memory_stats();
+    /* write the stats to the log */
+    void dump_gpu_memory_stats();
+
     /* set program to current program */
     void use_default_program();
 }
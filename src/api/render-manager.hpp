@@ -3,6 +3,7 @@
 
 #include "plugin.hpp"
 #include <vector>
+#include <array>
 #include <pixman.h>
 
 namespace OpenGL { struct context_t; }
@@ -38,14 +39,53 @@ using post_hook_t = std::function<void(uint32_t, uint32_t, uint32_t)>;
  * example plugin is cube. The parameter they take is the target framebuffer */
 using render_hook_t = std::function<void(uint32_t)>;
 
+/* capture hooks are used by screen recorders. They are called when a frame
+ * is complete, with the default framebuffer of the output bound for reading
+ * and the part of it which has changed since the last frame, in framebuffer
+ * coordinates (as used by glReadPixels()) */
+using capture_hook_t = std::function<void(pixman_region32_t*)>;
 
+
+/* Why a frame was (or wasn't) scanned out directly, see render_manager */
+enum wf_scanout_result
+{
+    WF_SCANOUT_OK = 0,
+    WF_SCANOUT_DISABLED,
+    /* custom renderer, effect hooks, post effects, zoom, etc. */
+    WF_SCANOUT_EFFECTS,
+    WF_SCANOUT_DRAG_ICON,
+    /* the top view isn't a fullscreen view */
+    WF_SCANOUT_NO_FULLSCREEN,
+    /* the view has transformers, alpha, decorations or is frozen */
+    WF_SCANOUT_TRANSFORMED,
+    /* popups or subsurfaces */
+    WF_SCANOUT_SUBSURFACES,
+    /* the buffer doesn't exactly cover the output */
+    WF_SCANOUT_GEOMETRY,
+    WF_SCANOUT_NOT_OPAQUE,
+    WF_SCANOUT_RESULT_TOTAL
+};
+
+struct wf_scanout_stats
+{
+    /* number of painted frames for each result */
+    uint64_t frames[WF_SCANOUT_RESULT_TOTAL] = {0};
+    /* how many times we started scanning out a surface */
+    uint64_t activations = 0;
+};
+
+struct wlr_surface;
 struct wf_output_damage;
+class wf_software_renderer;
+class wayfire_view_t;
 class render_manager
 {
 
     friend void redraw_idle_cb(void *data);
     friend void damage_idle_cb(void *data);
     friend void frame_cb (wl_listener*, void *data);
+    friend void scanout_surface_destroy_cb(wl_listener*, void *data);
+    friend int delayed_paint_cb(void *data);
 
     private:
         wayfire_output *output;
@@ -53,6 +93,26 @@ class render_manager
 
         wl_listener frame_listener;
 
+        /* Render delay: instead of painting right after the frame event, we
+         * can send frame done to clients and start painting as late as
+         * possible before the next vblank, so that clients which commit in
+         * the meantime make it into this frame.
+         *
+         * render_delay is "off", "auto" (predicted from recent paint times)
+         * or a fixed delay in milliseconds, render_delay_margin is the time
+         * in milliseconds we want to have left before the vblank */
+        wf_option render_delay_opt, render_delay_margin_opt;
+        wl_event_source *delayed_paint_source = NULL;
+        bool paint_scheduled = false, frame_done_sent = false;
+
+        /* durations of the last paints, in microseconds */
+        std::array<int64_t, 16> paint_durations;
+        size_t last_paint_duration = 0;
+
+        void handle_frame();
+        int get_render_delay();
+        void send_frame_done();
+
         signal_callback_t output_resized;
 
         bool dirty_context = true;
@@ -69,15 +129,91 @@ class render_manager
 
         void get_ws_damage(std::tuple<int, int> ws, pixman_region32_t *out_damage);
 
+        /* views which have collected damage since the last frame */
+        std::vector<wayfire_view_t*> damaged_views;
+        void flush_view_damage();
+
+        /* render-time magnification of the current workspace, see
+         * set_viewport_zoom(). The origin is in output-local coordinates */
+        float viewport_zoom = 1.0;
+        int viewport_zoom_x = 0, viewport_zoom_y = 0;
+
+        bool is_viewport_zoomed();
+        wlr_box get_zoomed_box(const wlr_box& box);
+
         using effect_container_t = std::vector<effect_hook_t*>;
         effect_container_t effects[WF_OUTPUT_EFFECT_TOTAL];
 
+        std::vector<capture_hook_t*> captures;
+        void run_captures(pixman_region32_t *swap_damage);
+
         struct wf_post_effect;
         /* TODO: use unique_ptr */
         using post_container_t = std::vector<wf_post_effect*>;
         post_container_t post_effects;
 
-        uint32_t default_fb = 0, default_tex = 0;
+        /* The render plan of the current frame, made by plan_frame().
+         *
+         * Without post effects the scene is rendered directly to the output.
+         * Otherwise it goes to post_targets[0], and each post effect reads
+         * the buffer the previous one wrote to. The scene buffer is repainted
+         * only where it is damaged, so it is never the target of a pass: the
+         * first pass reads it and writes to post_targets[1], and then pass i
+         * reads post_targets[1 + (i - 1) % 2] and writes to
+         * post_targets[1 + i % 2], so that the passes alternate between [1]
+         * and [2]. The last pass writes to the output instead. With more
+         * than three effects several passes write to the same buffer, so
+         * only the scene buffer keeps valid contents outside of the damage */
+        struct wf_render_target
+        {
+            uint32_t fb = -1, tex = -1;
+            int width = 0, height = 0;
+        };
+
+        struct wf_render_pass
+        {
+            wf_post_effect *effect;
+            uint32_t source_fb, source_tex, target_fb;
+        };
+
+        std::array<wf_render_target, 3> post_targets;
+        std::vector<wf_render_pass> post_passes;
+
+        uint32_t scene_target = 0;
+        /* whether the post passes must process the whole output,
+         * instead of only the damaged part */
+        bool post_full_damage = false;
+
+        void plan_frame();
+        void release_post_targets();
+
+        /* renders plain shm surfaces on the CPU, enabled with the
+         * software_renderer option of the output */
+        std::unique_ptr<wf_software_renderer> software_renderer;
+
+        /* Threaded pixman composition for outputs using the software
+         * renderer, see the render_thread option. paint() only starts the
+         * frame on the thread of the output, and it is uploaded and presented
+         * on the main thread when the thread is done. Meanwhile the main
+         * thread is free to serve clients and paint the other outputs.
+         * GL outputs are not threaded */
+        bool render_thread_enabled = false, threaded_frame_running = false;
+        pixman_region32_t threaded_damage;
+
+        bool start_threaded_frame();
+        void present_threaded_frame();
+
+        /* Direct scanout: if the only thing visible on the output is an
+         * opaque fullscreen surface, we give it to wlroots with
+         * wlr_output_set_fullscreen_surface() and skip our composition */
+        bool direct_scanout_enabled = true;
+        wlr_surface *scanout_surface = nullptr;
+        /* the surface can be destroyed before the next frame */
+        wl_listener scanout_surface_destroy;
+        wf_scanout_stats scanout_stats;
+
+        wf_scanout_result check_direct_scanout(wlr_surface*& surface);
+        void set_scanout_surface(wlr_surface *surface, wf_scanout_result result);
 
         int constant_redraw = 0;
         int output_inhibit = 0;
@@ -108,13 +244,30 @@ class render_manager
         void schedule_redraw();
         void set_hide_overlay_panels(bool set);
 
+        /* Magnify the current workspace zoom times, with the output-local
+         * point (x, y) in the top-left corner of the screen. Only surfaces
+         * which are visible are rendered, directly at the magnified size,
+         * and damage is mapped to the screen accordingly.
+         * zoom = 1 disables magnification */
+        void set_viewport_zoom(float zoom, int x, int y);
+
         void add_inhibit(bool add);
 
+        /* whether surfaces on this output should keep a copy of their
+         * contents in system memory, NOT API */
+        bool uses_software_renderer();
+
+        /* statistics of the direct scanout decisions, NOT API */
+        const wf_scanout_stats& get_scanout_stats();
+
         void add_effect(effect_hook_t*, wf_output_effect_type type);
         void rem_effect(const effect_hook_t*, wf_output_effect_type type);
 
-        /* add a new postprocessing effect */
-        void add_post(post_hook_t*);
+        /* add a new postprocessing effect. If damage_local is set, the effect
+         * doesn't change over time and each output pixel depends only on
+         * the same pixel of the source (for ex. color filters), so it is run
+         * only on the damaged part of the output */
+        void add_post(post_hook_t*, bool damage_local = false);
         /* Calling rem_post will remove the postprocessing effect as soon as
          * possible.
          *
@@ -124,8 +277,20 @@ class render_manager
          */
         void rem_post(post_hook_t*);
 
+        /* capture hooks see the whole output when they are added, and
+         * disable direct scanout while they are active */
+        void add_capture(capture_hook_t*);
+        void rem_capture(capture_hook_t*);
+
         void damage(const wlr_box& box);
         void damage(pixman_region32_t *region);
+        /* damage the given region, relative to the output, on every
+         * workspace, for ex. for views which are shown on all of them */
+        void damage_all_workspaces(pixman_region32_t *region);
+
+        /* NOT API, views with damage which must be applied before painting */
+        void queue_view_damage(wayfire_view_t *view);
+        void dequeue_view_damage(wayfire_view_t *view);
 
         void workspace_stream_start(wf_workspace_stream *stream);
         void workspace_stream_update(wf_workspace_stream *stream,
@@ -12,12 +12,23 @@
 class wf_view_transformer_t
 {
     public:
+        /* The view caches its transformed bounding box and recomputes it
+         * only if one of its transformers is dirty. Transformers must set
+         * this whenever something which affects the transformed geometry
+         * changes, the view clears it */
+        bool dirty = true;
+
         virtual wf_point local_to_transformed_point(wf_geometry view, wf_point point) = 0;
         virtual wf_point transformed_to_local_point(wf_geometry view, wf_point point) = 0;
 
         /* return the boundingbox of region after applying all transformations */
         virtual wlr_box get_bounding_box(wf_geometry view, wlr_box region);
 
+        /* Whether the damage of the view should be transformed box by box.
+         * Otherwise only the extents of the damage are transformed, which
+         * is cheaper and usually almost as good for complex transforms */
+        virtual bool transform_damage_boxes() { return false; }
+
         /* src_tex        the internal FBO texture,
          *
          * src_box        box of the view that has to be repainted, contains other transforms
@@ -47,18 +58,32 @@ class wf_2D_view : public wf_view_transformer_t
 {
     protected:
         wayfire_view view;
-    public:
+
         float angle = 0.0f;
         float scale_x = 1.0f, scale_y = 1.0f;
         float translation_x = 0.0f, translation_y = 0.0f;
+
+    public:
         float alpha = 1.0f;
 
+        void set_angle(float angle);
+        void set_scale(float scale_x, float scale_y);
+        void set_translation(float translation_x, float translation_y);
+
+        float get_angle() { return angle; }
+        float get_scale_x() { return scale_x; }
+        float get_scale_y() { return scale_y; }
+        float get_translation_x() { return translation_x; }
+        float get_translation_y() { return translation_y; }
+
     public:
         wf_2D_view(wayfire_view view);
 
         virtual wf_point local_to_transformed_point(wf_geometry view, wf_point point);
         virtual wf_point transformed_to_local_point(wf_geometry view, wf_point point);
 
+        virtual bool transform_damage_boxes() { return true; }
+
         virtual void render_with_damage(uint32_t src_tex,
                                         wlr_box src_box,
                                         wlr_box scissor_box,
@@ -71,10 +96,22 @@ class wf_3D_view : public wf_view_transformer_t
     protected:
         wayfire_view view;
 
-    public:
         glm::mat4 view_proj{1.0}, translation{1.0}, rotation{1.0}, scaling{1.0};
+
+        /* calculate_total_transform() is needed for every transformed point,
+         * so it is recomputed only when the matrices or the size of the
+         * output change */
+        glm::mat4 total_transform{1.0};
+        bool total_transform_dirty = true;
+        int output_width = 0, output_height = 0;
+
+    public:
         glm::vec4 color{1, 1, 1, 1};
 
+        void set_translation(const glm::mat4& translation);
+        void set_rotation(const glm::mat4& rotation);
+        void set_scaling(const glm::mat4& scaling);
+
         glm::mat4 calculate_total_transform();
 
     public:
@@ -5,6 +5,7 @@
 #include <vector>
 #include <map>
 #include <functional>
+#include <typeinfo>
 #include <pixman.h>
 #include <nonstd/observer_ptr.h>
 
@@ -49,6 +50,19 @@ struct wf_custom_view_data
     virtual ~wf_custom_view_data() {}
 };
 
+/* Custom view data and named transformers are looked up by small integer
+ * ids instead of by name. The id of a name is assigned the first time it is
+ * used and stays the same for the lifetime of the compositor, so plugins
+ * can get it once and keep it */
+uint32_t wf_get_name_id(const std::string& name);
+
+/* the id of the custom view data of type T */
+template<class T> uint32_t wf_get_data_id()
+{
+    static const uint32_t id = wf_get_name_id(typeid(T).name());
+    return id;
+}
+
 /* General TODO: mark member functions const where appropriate */
 
 class wayfire_view_t;
@@ -60,6 +74,7 @@ using wf_surface_iterator_callback = std::function<void(wayfire_surface_t*, int,
 
 class wf_decorator_frame_t;
 class wf_view_transformer_t;
+struct wf_surface_pixels;
 
 /* abstraction for desktop-apis, no real need for plugins
  * This is a base class to all "drawables" - desktop views, subsurfaces, popups */
@@ -77,17 +92,26 @@ class wayfire_surface_t
         virtual void get_child_position(int &x, int &y);
 
         wf_geometry geometry = {0, 0, 0, 0};
+        /* the output geometry at the last commit */
+        wf_geometry committed_box = {0, 0, 0, 0};
 
         virtual bool is_subsurface();
         virtual void damage(const wlr_box& box);
         virtual void damage(pixman_region32_t *region);
 
+        /* the size or the position of this surface or one of its children
+         * might have changed. Passed up to the view, which caches the
+         * bounding box of all of its surfaces */
+        virtual void surface_tree_changed();
+
         void apply_surface_damage(int x, int y);
 
         struct wlr_fb_attribs
         {
             int width, height;
             wl_output_transform transform = WL_OUTPUT_TRANSFORM_NORMAL;
+            /* surface coordinates are scaled by the output scale and zoom */
+            float zoom = 1.0;
         };
 
         virtual void _wlr_render_box(const wlr_fb_attribs& fb, int x, int y, const wlr_box& scissor);
@@ -139,6 +163,9 @@ class wayfire_surface_t
 
         float alpha = 1.0;
 
+        /* copy of the contents for the software renderer, NOT API */
+        std::unique_ptr<wf_surface_pixels> pixels;
+
         /* returns top-left corner in output coordinates */
         virtual wf_point get_output_position();
 
@@ -194,6 +221,28 @@ class wayfire_view_t : public wayfire_surface_t
 
         uint32_t id;
         virtual void damage(const wlr_box& box);
+        virtual void damage(pixman_region32_t *region);
+        /* damage the given untransformed box on the output, without
+         * invalidating the snapshot */
+        void damage_transformed(const wlr_box& box);
+        /* damage the given box in output coordinates */
+        void damage_output_box(const wlr_box& box);
+
+        /* Damage in output coordinates. Clients commit many small damage
+         * boxes, so they are collected while handling events and given to
+         * the output once per frame, see flush_damage() */
+        pixman_region32_t pending_damage;
+        bool damage_queued = false;
+        void queue_damage();
+
+        /* Damage of a transformed view, in untransformed coordinates. It is
+         * collected during the frame and transformed only once, see
+         * flush_transformed_damage() */
+        pixman_region32_t transformed_damage;
+        /* the view or its transforms are about to change, so we can't
+         * transform the pending damage anymore. Damage the whole view
+         * as it was transformed until now instead */
+        void flush_transformed_damage_conservative();
 
         struct offscreen_buffer_t
         {
@@ -202,17 +251,19 @@ class wayfire_view_t : public wayfire_surface_t
             int32_t output_x = 0, output_y = 0;
             int32_t fb_width = 0, fb_height = 0;
             float fb_scale = 1;
-            pixman_region32_t cached_damage;
+            /* the view was damaged since the snapshot was rendered */
+            bool dirty = true;
 
-            void init(int w, int h);
+            void init(int w, int h, std::function<bool()> evict);
             void fini();
             bool valid();
 
         } offscreen_buffer;
+        float snapshot_scale = 1;
 
         struct transform_t
         {
-            std::string plugin_name = "";
+            uint32_t name_id = 0;
             bool to_remove = false;
             std::unique_ptr<wf_view_transformer_t> transform;
             wf_framebuffer fb;
@@ -223,9 +274,30 @@ class wayfire_view_t : public wayfire_surface_t
         void _pop_transformer(nonstd::observer_ptr<transform_t>);
         void cleanup_transforms();
 
+        /* indexed by data id */
+        std::vector<std::unique_ptr<wf_custom_view_data>> custom_data;
+
         virtual wf_geometry get_untransformed_bounding_box();
         void reposition_relative_to_parent();
 
+        /* get_untransformed_bounding_box() of a mapped view, invalidated
+         * when the view is damaged or its surface tree changes, and the box
+         * of the view after each of its transforms, recomputed when the
+         * untransformed box changes or a transformer is dirty */
+        struct bounding_box_cache_t
+        {
+            bool untransformed_valid = false;
+            wf_geometry untransformed;
+
+            /* stages[i] is the view box given to the i-th transformer,
+             * the last one is the transformed bounding box */
+            std::vector<wf_geometry> stages;
+        } bbox_cache;
+
+        virtual void surface_tree_changed();
+        /* make sure bbox_cache.stages is up to date */
+        void update_transformed_boxes();
+
         uint32_t edges = 0;
 
     public:
@@ -239,8 +311,41 @@ class wayfire_view_t : public wayfire_surface_t
 
         wf_view_role role = WF_VIEW_ROLE_TOPLEVEL;
 
-        /* plugins can subclass wf_custom_view_data and use it to store view-specific information */
-        std::map<std::string, std::unique_ptr<wf_custom_view_data>> custom_data;
+        /* Plugins can subclass wf_custom_view_data and use it to store
+         * view-specific information. Data is stored under the id of its type,
+         * see wf_get_data_id(), or under the id of a name if a plugin
+         * stores the same type several times */
+        wf_custom_view_data *get_data(uint32_t id);
+        void store_data(uint32_t id, std::unique_ptr<wf_custom_view_data> data);
+        void erase_data(uint32_t id);
+
+        /* returns NULL if the view has no data of type T */
+        template<class T> T *get_data()
+        { return static_cast<T*> (get_data(wf_get_data_id<T>())); }
+
+        /* returns the data of type T, default-constructed if it doesn't exist yet */
+        template<class T> T *get_data_safe()
+        {
+            auto data = get_data<T>();
+            if (!data)
+            {
+                data = new T;
+                store_data(wf_get_data_id<T>(), std::unique_ptr<wf_custom_view_data>(data));
+            }
+
+            return data;
+        }
+
+        template<class T> void erase_data()
+        { erase_data(wf_get_data_id<T>()); }
+
+        /* the layer of the view and its slot in the layer's stacking array,
+         * maintained by the workspace manager, NOT API */
+        struct layer_slot_t
+        {
+            uint32_t layer = 0;
+            size_t index = 0;
+        } layer_slot;
 
         wayfire_view_t();
         virtual ~wayfire_view_t();
@@ -307,6 +412,18 @@ class wayfire_view_t : public wayfire_surface_t
 
         virtual void damage();
 
+        /* Damage only the area the view covers on the output. Unlike damage(),
+         * this doesn't mean the contents of the view have changed, so plugins
+         * should use it when they only change the view's transform */
+        void damage_bounding_box();
+
+        /* apply the damage collected for a transformed view, NOT API */
+        void flush_transformed_damage();
+        /* apply all damage collected since the last frame, NOT API.
+         * The render manager must have already dropped the view from its
+         * queue, see render_manager::dequeue_view_damage() */
+        void flush_damage();
+
         virtual std::string get_app_id() { return ""; }
         virtual std::string get_title() { return ""; }
 
@@ -348,8 +465,8 @@ class wayfire_view_t : public wayfire_surface_t
          * where each transform is fed the result of the previous transforms
          *
          * Damage tracking for transformed views is done on the boundingbox of the
-         * damaged region after applying the transformation, but all damaged parts
-         * of the internal FBO are updated.
+         * damaged region after applying the transformation. The internal FBO is
+         * kept between frames and rendered again only if the view was damaged.
          * */
 
         void add_transformer(std::unique_ptr<wf_view_transformer_t> transformer);
@@ -364,12 +481,36 @@ class wayfire_view_t : public wayfire_surface_t
         void pop_transformer(nonstd::observer_ptr<wf_view_transformer_t> transformer);
         void pop_transformer(std::string name);
 
+        /* the same, with the id of the name (see wf_get_name_id()), for
+         * plugins which look up their transformer at each frame */
+        void add_transformer(std::unique_ptr<wf_view_transformer_t> transformer, uint32_t name_id);
+        nonstd::observer_ptr<wf_view_transformer_t> get_transformer(uint32_t name_id);
+        void pop_transformer(uint32_t name_id);
+
         bool has_transformer();
 
         virtual void render_fb(pixman_region32_t* damage, wf_framebuffer framebuffer);
 
         bool has_snapshot = false;
+        /* update the snapshot, if the view was damaged since the last one */
         virtual void take_snapshot();
+
+        /* Thumbnails: plugins which show the view scaled down (switcher,
+         * overviews, etc.) can set the scale of the snapshot, relative to the
+         * output scale, so that the view is rendered only at the size it is
+         * shown. Since the snapshot is redrawn only when the view is damaged,
+         * an idle view costs just a texture draw per frame.
+         * Plugins should reset the scale to 1 when they are done */
+        void set_snapshot_scale(float scale);
+        float get_snapshot_scale() { return snapshot_scale; }
+
+        /* A frozen view keeps showing its snapshot from the moment it was
+         * frozen, and its damage is ignored, until it is thawed. Used by
+         * layout transactions (see layout-transaction.hpp), NOT API */
+        bool frozen = false;
+        /* returns false if the view has nothing to show yet */
+        bool freeze();
+        void thaw();
 };
 
 wayfire_view wl_surface_to_wayfire_view(wl_resource *surface);
@@ -17,13 +17,16 @@ extern "C"
 #include <unistd.h>
 #include <sys/wait.h>
 #include <fcntl.h>
+#include <signal.h>
 
 #include "output.hpp"
+#include "opengl.hpp"
 #include "core.hpp"
 #include "workspace-manager.hpp"
 #include "seat/input-manager.hpp"
 #include "seat/input-inhibit.hpp"
 #include "seat/touch.hpp"
+#include "launcher.hpp"
 #include "../output/wayfire-shell.hpp"
 #include "view/priv-view.hpp"
 #include "config.h"
@@ -122,10 +125,20 @@ static void handle_input_inhibit_deactivated(wl_listener*, void*)
     core->input->set_exclusive_focus(nullptr);
 }
 
+/* kill -USR2 writes the GPU memory usage to the log */
+static int handle_dump_gpu_memory(int, void*)
+{
+    OpenGL::dump_gpu_memory_stats();
+    return 0;
+}
+
 void wayfire_core::init(wayfire_config *conf)
 {
     configure(conf);
     device_config::load(conf);
+    launcher::init(ev_loop);
+
+    wl_event_loop_add_signal(ev_loop, SIGUSR2, handle_dump_gpu_memory, NULL);
 
     protocols.data_device = wlr_data_device_manager_create(display);
     wlr_renderer_init_wl_display(renderer, display);
@@ -227,9 +240,10 @@ std::tuple<int, int> wayfire_core::get_touch_position(int id)
     if (!input->our_touch)
         return std::make_tuple(0, 0);
 
-    auto it = input->our_touch->gesture_recognizer.current.find(id);
-    if (it != input->our_touch->gesture_recognizer.current.end())
-        return std::make_tuple(it->second.sx, it->second.sy);
+    const auto& fingers = input->our_touch->gesture_recognizer.fingers;
+    int i = fingers.find(id);
+    if (i >= 0)
+        return std::make_tuple(fingers.sx[i], fingers.sy[i]);
 
     return std::make_tuple(0, 0);
 }
@@ -507,28 +521,7 @@ void wayfire_core::erase_view(wayfire_view v)
 
 void wayfire_core::run(const char *command)
 {
-    pid_t pid = fork();
-
-    /* The following is a "hack" for disowning the child processes,
-     * otherwise they will simply stay as zombie processes */
-    if (!pid) {
-        if (!fork()) {
-            setenv("WAYLAND_DISPLAY", wayland_display.c_str(), 1);
-            auto xdisp = ":" + xwayland_get_display();
-            setenv("DISPLAY", xdisp.c_str(), 1);
-
-            int dev_null = open("/dev/null", O_WRONLY);
-            dup2(dev_null, 1);
-            dup2(dev_null, 2);
-
-            exit(execl("/bin/sh", "/bin/bash", "-c", command, NULL));
-        } else {
-            exit(0);
-        }
-    } else {
-        int status;
-        waitpid(pid, &status, 0);
-    }
+    launcher::run(command, wayland_display, ":" + xwayland_get_display());
 }
 
 void wayfire_core::move_view_to_output(wayfire_view v, wayfire_output *new_output)
@@ -0,0 +1,252 @@
+#include "launcher.hpp"
+#include "debug.hpp"
+#include <config.hpp>
+
+#include <set>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+
+#include <spawn.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include <wayland-server.h>
+
+extern char **environ;
+
+namespace launcher
+{
+    namespace
+    {
+        /* socket to the helper process, -1 if we spawn processes ourselves */
+        int helper_fd = -1;
+
+        /* processes we have to reap, including the helper */
+        std::set<pid_t> children;
+
+        /* a request to the helper is the wayland display, the X display
+         * and the command, separated by '\0' */
+        const size_t max_request_size = 64 * 1024;
+    }
+
+    /* characters which mean we need the shell to run the command:
+     * pipes, redirections, quotes, variables, globs, etc. */
+    static bool needs_shell(const std::string& command)
+    {
+        static const char *metacharacters = "|&;<>()$`\\\"'*?[]{}#~\n";
+        if (command.find_first_of(metacharacters) != std::string::npos)
+            return true;
+
+        /* variable assignment, like "FOO=bar program" */
+        auto first_word = command.substr(0, command.find_first_of(" \t"));
+        return first_word.find('=') != std::string::npos;
+    }
+
+    static std::vector<std::string> split_command(const std::string& command)
+    {
+        std::vector<std::string> args;
+
+        size_t start = command.find_first_not_of(" \t");
+        while (start != std::string::npos)
+        {
+            size_t end = command.find_first_of(" \t", start);
+            args.push_back(command.substr(start, end - start));
+            start = command.find_first_not_of(" \t", end);
+        }
+
+        return args;
+    }
+
+    static pid_t spawn(const std::string& command, const std::string& wayland_display,
+                       const std::string& x_display)
+    {
+        bool use_shell = needs_shell(command);
+
+        std::vector<std::string> args;
+        if (use_shell)
+            args = {"/bin/sh", "-c", command};
+        else
+            args = split_command(command);
+
+        if (args.empty())
+            return -1;
+
+        std::vector<char*> argv;
+        for (auto& arg : args)
+            argv.push_back(&arg[0]);
+        argv.push_back(nullptr);
+
+        /* our environment, pointed to the displays of this session */
+        std::string wayland_env = "WAYLAND_DISPLAY=" + wayland_display;
+        std::string x_env = "DISPLAY=" + x_display;
+
+        std::vector<char*> envp;
+        for (char **env = environ; *env; env++)
+        {
+            if (strncmp(*env, "WAYLAND_DISPLAY=", 16) && strncmp(*env, "DISPLAY=", 8))
+                envp.push_back(*env);
+        }
+
+        envp.push_back(&wayland_env[0]);
+        envp.push_back(&x_env[0]);
+        envp.push_back(nullptr);
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+        posix_spawn_file_actions_adddup2(&actions, 1, 2);
+
+        /* we block SIGCHLD to read it from the event loop and the helper
+         * ignores it, the child must start with a clean state */
+        sigset_t mask, defaults;
+        sigemptyset(&mask);
+        sigemptyset(&defaults);
+        sigaddset(&defaults, SIGCHLD);
+        sigaddset(&defaults, SIGPIPE);
+
+        posix_spawnattr_t attr;
+        posix_spawnattr_init(&attr);
+        posix_spawnattr_setsigmask(&attr, &mask);
+        posix_spawnattr_setsigdefault(&attr, &defaults);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+        pid_t pid;
+        int r;
+        if (use_shell)
+            r = posix_spawn(&pid, argv[0], &actions, &attr, argv.data(), envp.data());
+        else
+            r = posix_spawnp(&pid, argv[0], &actions, &attr, argv.data(), envp.data());
+
+        posix_spawnattr_destroy(&attr);
+        posix_spawn_file_actions_destroy(&actions);
+
+        if (r != 0)
+        {
+            log_error("failed to run %s: %s", command.c_str(), strerror(r));
+            return -1;
+        }
+
+        return pid;
+    }
+
+    static void helper_main(int fd)
+    {
+        /* we don't care about the exit status of the programs, let the
+         * kernel reap them */
+        signal(SIGCHLD, SIG_IGN);
+
+        std::vector<char> buffer(max_request_size);
+        while (true)
+        {
+            ssize_t len = recv(fd, buffer.data(), buffer.size(), 0);
+            if (len < 0 && errno == EINTR)
+                continue;
+
+            /* the compositor has exited */
+            if (len <= 0)
+                _exit(0);
+
+            std::string request(buffer.data(), len);
+
+            size_t first = request.find('\0');
+            size_t second = first == std::string::npos ?
+                std::string::npos : request.find('\0', first + 1);
+
+            if (second == std::string::npos)
+                continue;
+
+            spawn(request.substr(second + 1), request.substr(0, first),
+                  request.substr(first + 1, second - first - 1));
+        }
+    }
+
+    void start_helper(wayfire_config *config)
+    {
+        auto section = config->get_section("core");
+        if (!section->get_option("launcher_helper", "0")->as_int())
+            return;
+
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0)
+        {
+            log_error("failed to create launcher helper socket: %s", strerror(errno));
+            return;
+        }
+
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            log_error("failed to fork launcher helper: %s", strerror(errno));
+            close(fds[0]);
+            close(fds[1]);
+            return;
+        }
+
+        if (pid == 0)
+        {
+            close(fds[0]);
+            helper_main(fds[1]);
+        }
+
+        close(fds[1]);
+        helper_fd = fds[0];
+        children.insert(pid);
+    }
+
+    static int handle_child_exited(int, void*)
+    {
+        auto it = children.begin();
+        while (it != children.end())
+        {
+            int status;
+            if (waitpid(*it, &status, WNOHANG) != 0)
+                it = children.erase(it);
+            else
+                ++it;
+        }
+
+        return 0;
+    }
+
+    void init(wl_event_loop *loop)
+    {
+        wl_event_loop_add_signal(loop, SIGCHLD, handle_child_exited, NULL);
+
+        /* in case the helper has already exited */
+        handle_child_exited(0, NULL);
+    }
+
+    void run(const std::string& command, const std::string& wayland_display,
+             const std::string& x_display)
+    {
+        if (helper_fd >= 0)
+        {
+            std::string request = wayland_display + '\0' + x_display + '\0' + command;
+
+            if (request.size() <= max_request_size)
+            {
+                ssize_t sent = send(helper_fd, request.data(), request.size(),
+                                    MSG_NOSIGNAL | MSG_DONTWAIT);
+
+                if (sent == (ssize_t)request.size())
+                    return;
+
+                /* the helper is just busy, don't give up on it */
+                if (sent < 0 && errno != EAGAIN)
+                {
+                    log_error("launcher helper has died, running commands directly");
+                    close(helper_fd);
+                    helper_fd = -1;
+                }
+            }
+        }
+
+        pid_t pid = spawn(command, wayland_display, x_display);
+        if (pid > 0)
+            children.insert(pid);
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef LAUNCHER_HPP
+#define LAUNCHER_HPP
+
+#include <string>
+
+class wayfire_config;
+struct wl_event_loop;
+
+/* Starts the programs requested with core->run().
+ *
+ * Commands without shell metacharacters are split on whitespace and
+ * executed directly, everything else goes through /bin/sh -c. Processes are
+ * started with posix_spawn(), which doesn't copy our (big) address space,
+ * or, if [core] launcher_helper is set, by a small helper process which is
+ * forked at startup, before we have mapped anything big */
+namespace launcher
+{
+    /* fork the helper if it is enabled. Must be called before creating the
+     * backend, the helper is a copy of the compositor at this point */
+    void start_helper(wayfire_config *config);
+
+    /* start reaping the processes we spawned */
+    void init(wl_event_loop *loop);
+
+    void run(const std::string& command, const std::string& wayland_display,
+             const std::string& x_display);
+}
+
+#endif /* end of include guard: LAUNCHER_HPP */
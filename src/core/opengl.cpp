@@ -6,9 +6,38 @@
 #include "render-manager.hpp"
 
 #include <glm/gtc/matrix_transform.hpp>
+#include <config.hpp>
+
+#include <algorithm>
+#include <vector>
+#include <ctime>
 
 namespace {
     OpenGL::context_t *bound;
+
+    struct render_target_t
+    {
+        GLuint fbuff, tex;
+        int width, height;
+
+        wf_gpu_memory_category category;
+        std::function<bool()> evict;
+        int64_t last_used;
+
+        size_t size() const { return 4ull * width * height; }
+    };
+
+    /* in use, and in the pool, least recently released first */
+    std::vector<render_target_t> render_targets;
+    std::vector<render_target_t> render_target_pool;
+
+    wf_gpu_memory_stats gpu_memory_stats;
+    bool reclaiming = false, over_budget = false;
+
+    /* targets unused for less than that aren't evicted */
+    const int64_t evict_idle_msec = 1000;
+    /* at most this many released targets are kept */
+    const size_t max_pooled_targets = 8;
 }
 
 const char* gl_error_string(const GLenum err) {
@@ -268,6 +297,32 @@ namespace OpenGL
         GL_CALL(glDisableVertexAttribArray(bound->position));
     }
 
+    void render_textured_quads(GLuint tex, const GLfloat *vertices,
+                               const GLfloat *uv, int quad_count,
+                               glm::mat4 model, glm::vec4 color)
+    {
+        if (quad_count <= 0)
+            return;
+
+        GL_CALL(glUseProgram(bound->program));
+        GL_CALL(glActiveTexture(GL_TEXTURE0));
+        GL_CALL(glBindTexture(GL_TEXTURE_2D, tex));
+
+        GL_CALL(glVertexAttribPointer(bound->position, 2, GL_FLOAT, GL_FALSE, 0, vertices));
+        GL_CALL(glEnableVertexAttribArray(bound->position));
+
+        GL_CALL(glVertexAttribPointer(bound->uvPosition, 2, GL_FLOAT, GL_FALSE, 0, uv));
+        GL_CALL(glEnableVertexAttribArray(bound->uvPosition));
+
+        GL_CALL(glUniformMatrix4fv(bound->mvpID, 1, GL_FALSE, &model[0][0]));
+        GL_CALL(glUniform4fv(bound->colorID, 1, &color[0]));
+        GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+        GL_CALL(glDrawArrays(GL_TRIANGLES, 0, 6 * quad_count));
+
+        GL_CALL(glDisableVertexAttribArray(bound->uvPosition));
+        GL_CALL(glDisableVertexAttribArray(bound->position));
+    }
+
     void prepare_framebuffer(GLuint &fbuff, GLuint &texture,
                              float scale_x, float scale_y)
     {
@@ -334,6 +389,230 @@ namespace OpenGL
     }
 
 
+    static int64_t get_time_msec()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000ll + ts.tv_nsec / 1000000;
+    }
+
+    static size_t get_gpu_memory_budget()
+    {
+        auto section = core->config->get_section("core");
+        return std::max(section->get_option("gpu_memory_budget", "1024")->as_int(), 0)
+            * 1024ull * 1024ull;
+    }
+
+    static size_t get_gpu_memory_used()
+    {
+        size_t used = gpu_memory_stats.pool_bytes;
+        for (auto bytes : gpu_memory_stats.bytes)
+            used += bytes;
+
+        return used;
+    }
+
+    static void destroy_pooled_target(size_t i)
+    {
+        auto& target = render_target_pool[i];
+        GL_CALL(glDeleteFramebuffers(1, &target.fbuff));
+        GL_CALL(glDeleteTextures(1, &target.tex));
+
+        gpu_memory_stats.pool_bytes -= target.size();
+        gpu_memory_stats.pool_targets--;
+        render_target_pool.erase(render_target_pool.begin() + i);
+    }
+
+    /* make room for needed more bytes: first free the pool, then evict
+     * the targets which have been idle for the longest time */
+    static void reclaim_gpu_memory(size_t needed)
+    {
+        size_t budget = get_gpu_memory_budget();
+        if (!budget || reclaiming)
+            return;
+
+        auto over = [=] () { return get_gpu_memory_used() + needed > budget; };
+        while (over() && !render_target_pool.empty())
+            destroy_pooled_target(0);
+
+        if (!over())
+        {
+            over_budget = false;
+            return;
+        }
+
+        auto now = get_time_msec();
+        std::vector<render_target_t*> idle;
+        for (auto& target : render_targets)
+        {
+            if (target.evict && now - target.last_used >= evict_idle_msec)
+                idle.push_back(&target);
+        }
+
+        std::sort(idle.begin(), idle.end(),
+                  [] (render_target_t *a, render_target_t *b)
+                  { return a->last_used < b->last_used; });
+
+        /* evicting releases targets, which changes render_targets */
+        std::vector<std::pair<GLuint, std::function<bool()>>> candidates;
+        for (auto target : idle)
+            candidates.push_back({target->fbuff, target->evict});
+
+        reclaiming = true;
+        for (auto& candidate : candidates)
+        {
+            if (!over())
+                break;
+
+            if (!candidate.second())
+                continue;
+
+            ++gpu_memory_stats.evictions;
+
+            /* the evicted target is in the pool now */
+            for (size_t i = 0; i < render_target_pool.size(); i++)
+            {
+                if (render_target_pool[i].fbuff == candidate.first)
+                {
+                    destroy_pooled_target(i);
+                    break;
+                }
+            }
+        }
+        reclaiming = false;
+
+        if (over() && !over_budget)
+        {
+            log_info("GPU memory budget of %zu MiB exceeded, using %zu MiB",
+                     budget >> 20, (get_gpu_memory_used() + needed) >> 20);
+        }
+
+        over_budget = over();
+    }
+
+    void allocate_render_target(int w, int h, GLuint& fbuff, GLuint& texture,
+                                wf_gpu_memory_category category,
+                                std::function<bool()> evict)
+    {
+        render_target_t target;
+        target.width = std::max(w, 1);
+        target.height = std::max(h, 1);
+
+        auto it = std::find_if(render_target_pool.begin(), render_target_pool.end(),
+                               [&] (const render_target_t& pooled)
+                               {
+                                   return pooled.width == target.width &&
+                                       pooled.height == target.height;
+                               });
+
+        if (it != render_target_pool.end())
+        {
+            target.fbuff = it->fbuff;
+            target.tex = it->tex;
+
+            gpu_memory_stats.pool_bytes -= it->size();
+            gpu_memory_stats.pool_targets--;
+            render_target_pool.erase(it);
+
+            ++gpu_memory_stats.pool_hits;
+        } else
+        {
+            reclaim_gpu_memory(target.size());
+
+            target.fbuff = target.tex = -1;
+            prepare_framebuffer_size(target.width, target.height,
+                                     target.fbuff, target.tex);
+
+            ++gpu_memory_stats.allocations;
+        }
+
+        target.category = category;
+        target.evict = evict;
+        target.last_used = get_time_msec();
+
+        gpu_memory_stats.bytes[category] += target.size();
+        gpu_memory_stats.targets[category]++;
+        render_targets.push_back(target);
+
+        fbuff = target.fbuff;
+        texture = target.tex;
+    }
+
+    void release_render_target(GLuint& fbuff, GLuint& texture)
+    {
+        if (fbuff == (GLuint)-1)
+            return;
+
+        auto it = std::find_if(render_targets.begin(), render_targets.end(),
+                               [=] (const render_target_t& target)
+                               { return target.fbuff == fbuff; });
+
+        if (it == render_targets.end())
+        {
+            /* not one of ours */
+            GL_CALL(glDeleteFramebuffers(1, &fbuff));
+            GL_CALL(glDeleteTextures(1, &texture));
+        } else
+        {
+            auto target = *it;
+            render_targets.erase(it);
+
+            gpu_memory_stats.bytes[target.category] -= target.size();
+            gpu_memory_stats.targets[target.category]--;
+
+            target.evict = nullptr;
+            render_target_pool.push_back(target);
+            gpu_memory_stats.pool_bytes += target.size();
+            gpu_memory_stats.pool_targets++;
+
+            if (render_target_pool.size() > max_pooled_targets)
+                destroy_pooled_target(0);
+
+            reclaim_gpu_memory(0);
+        }
+
+        fbuff = texture = -1;
+    }
+
+    void touch_render_target(GLuint fbuff)
+    {
+        for (auto& target : render_targets)
+        {
+            if (target.fbuff == fbuff)
+            {
+                target.last_used = get_time_msec();
+                return;
+            }
+        }
+    }
+
+    const wf_gpu_memory_stats& get_gpu_memory_stats()
+    {
+        return gpu_memory_stats;
+    }
+
+    void dump_gpu_memory_stats()
+    {
+        static const char *category_names[] = {"workspace streams", "snapshots",
+            "transforms", "post effects", "other"};
+
+        const auto& stats = gpu_memory_stats;
+        log_info("GPU memory: %zu MiB used, budget %zu MiB",
+                 get_gpu_memory_used() >> 20, get_gpu_memory_budget() >> 20);
+
+        for (int i = 0; i < WF_GPU_MEMORY_CATEGORY_TOTAL; i++)
+        {
+            log_info("    %s: %d targets, %zu KiB", category_names[i],
+                     stats.targets[i], stats.bytes[i] >> 10);
+        }
+
+        log_info("    pool: %d targets, %zu KiB", stats.pool_targets, stats.pool_bytes >> 10);
+        log_info("    %llu allocations, %llu reused from the pool, %llu evictions",
+                 (unsigned long long)stats.allocations,
+                 (unsigned long long)stats.pool_hits,
+                 (unsigned long long)stats.evictions);
+    }
+
     GLuint duplicate_texture(GLuint tex, int w, int h)
     {
         GLuint dst_tex = -1;
@@ -359,16 +638,13 @@ namespace OpenGL
 
 void wf_framebuffer::init()
 {
-    tex = fb = -1;
-    OpenGL::prepare_framebuffer(fb, tex, 1, 1);
-    geometry.width = bound->width;
-    geometry.height = bound->height;
+    init(bound->width, bound->height);
 }
 
 void wf_framebuffer::init(int w, int h)
 {
     tex = fb = -1;
-    OpenGL::prepare_framebuffer_size(w, h, fb, tex, 1, 1);
+    OpenGL::allocate_render_target(w, h, fb, tex, WF_GPU_MEMORY_TRANSFORM);
     geometry.width = w;
     geometry.height = h;
 }
@@ -398,14 +674,7 @@ void wf_framebuffer::clear() const
 
 void wf_framebuffer::release()
 {
-    if (fb == uint32_t(-1))
-        return;
-
-    GL_CALL(glDeleteFramebuffers(1, &fb));
-    GL_CALL(glDeleteTextures(1, &tex));
-
-    fb = -1;
-    tex = -1;
+    OpenGL::release_render_target(fb, tex);
 }
 
 
@@ -0,0 +1,100 @@
+#ifndef BINDING_INDEX_HPP
+#define BINDING_INDEX_HPP
+
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+
+#include "seat.hpp"
+
+/* Key, button and axis bindings are looked up by the output they belong to,
+ * the exact modifier state and the key/button code (0 for axis bindings) */
+struct wf_binding_key
+{
+    wayfire_output *output;
+    uint32_t mod;
+    uint32_t code;
+
+    bool operator == (const wf_binding_key& other) const
+    {
+        return output == other.output && mod == other.mod && code == other.code;
+    }
+};
+
+struct wf_binding_key_hash
+{
+    size_t operator () (const wf_binding_key& key) const
+    {
+        size_t hash = std::hash<wayfire_output*>()(key.output);
+        hash ^= std::hash<uint32_t>()(key.mod) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        hash ^= std::hash<uint32_t>()(key.code) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        return hash;
+    }
+};
+
+/* Hash index over bindings, so that dispatching an event is a single lookup
+ * instead of a walk over all bindings of all plugins on all outputs.
+ *
+ * Binding must provide get_binding_key(), which reads its option, an
+ * indexed_key field, which holds the key it is currently stored under, and
+ * the usual id and call from wf_callback. Bindings whose option changes must
+ * be updated with update() */
+template<class Binding> class wf_binding_index
+{
+    std::unordered_map<wf_binding_key, std::vector<Binding*>, wf_binding_key_hash> buckets;
+
+    static bool compare_id(const Binding *a, const Binding *b)
+    {
+        return a->id < b->id;
+    }
+
+    public:
+    void add(Binding *binding)
+    {
+        binding->indexed_key = binding->get_binding_key();
+
+        /* keep each bucket sorted by id, so that callbacks are still called in
+         * the order they were added in */
+        auto& bucket = buckets[binding->indexed_key];
+        bucket.insert(std::upper_bound(bucket.begin(), bucket.end(), binding, compare_id),
+                      binding);
+    }
+
+    void remove(Binding *binding)
+    {
+        auto it = buckets.find(binding->indexed_key);
+        if (it == buckets.end())
+            return;
+
+        auto& bucket = it->second;
+        bucket.erase(std::remove(bucket.begin(), bucket.end(), binding), bucket.end());
+
+        if (bucket.empty())
+            buckets.erase(it);
+    }
+
+    /* re-index a binding after its option has changed */
+    void update(Binding *binding)
+    {
+        if (binding->get_binding_key() == binding->indexed_key)
+            return;
+
+        remove(binding);
+        add(binding);
+    }
+
+    /* Append the callbacks of all bindings matching key to result.
+     * Doesn't allocate as long as result has enough capacity */
+    template<class Callback>
+    void match(const wf_binding_key& key, std::vector<Callback*>& result) const
+    {
+        auto it = buckets.find(key);
+        if (it == buckets.end())
+            return;
+
+        for (auto binding : it->second)
+            result.push_back(binding->call);
+    }
+};
+
+#endif /* end of include guard: BINDING_INDEX_HPP */
@@ -8,6 +8,7 @@
 static void handle_pointer_button_cb(wl_listener*, void *data)
 {
     auto ev = static_cast<wlr_event_pointer_button*> (data);
+    core->input->flush_pointer_motion();
     core->input->handle_pointer_button(ev);
     wlr_seat_pointer_notify_button(core->input->seat, ev->time_msec, ev->button, ev->state);
     wlr_idle_notify_activity(core->protocols.idle, core->get_current_seat());
@@ -30,6 +31,7 @@ static void handle_pointer_motion_absolute_cb(wl_listener*, void *data)
 static void handle_pointer_axis_cb(wl_listener*, void *data)
 {
     auto ev = static_cast<wlr_event_pointer_axis*> (data);
+    core->input->flush_pointer_motion();
     core->input->handle_pointer_axis(ev);
     wlr_idle_notify_activity(core->protocols.idle, core->get_current_seat());
 }
@@ -49,20 +51,17 @@ void input_manager::handle_pointer_button(wlr_event_pointer_button *ev)
         core->focus_output(output);
 
         std::vector<button_callback*> callbacks;
+        callbacks.swap(button_dispatch_buffer);
+        callbacks.clear();
 
-        auto mod_state = get_modifiers();
-        for (auto& pair : button_bindings)
-        {
-            auto& binding = pair.second;
-            const auto button = binding->button->as_cached_button();
-            if (binding->output == core->get_active_output() &&
-                mod_state == button.mod && ev->button == button.button)
-                callbacks.push_back(binding->call);
-        }
+        button_index.match({core->get_active_output(), get_modifiers(), ev->button},
+                           callbacks);
 
         GetTuple(ox, oy, core->get_active_output()->get_cursor_position());
         for (auto call : callbacks)
             (*call) (ev->button, ox, oy);
+
+        button_dispatch_buffer.swap(callbacks);
     } else
     {
         count_other_inputs--;
@@ -110,6 +109,10 @@ void input_manager::update_cursor_position(uint32_t time_msec, bool real_update)
     auto output = core->get_output_at(cursor->x, cursor->y);
     assert(output);
 
+    /* for plugins which follow the pointer without grabbing input, i.e zoom */
+    if (real_update)
+        output->emit_signal("pointer-motion", nullptr);
+
     if (input_grabbed() && real_update)
     {
         GetTuple(sx, sy, core->get_active_output()->get_cursor_position());
@@ -120,7 +123,7 @@ void input_manager::update_cursor_position(uint32_t time_msec, bool real_update)
 
     GetTuple(px, py, output->get_cursor_position());
     int sx, sy;
-    wayfire_surface_t *new_focus = NULL;
+    wayfire_surface_t *new_focus = NULL, *old_focus = cursor_focus;
 
     output->workspace->for_each_view(
         [&] (wayfire_view view)
@@ -139,6 +142,19 @@ void input_manager::update_cursor_position(uint32_t time_msec, bool real_update)
         compositor_surface->on_pointer_motion(sx, sy);
     } else if (real_update)
     {
+        /* the client still gets all of the queued motion, relative to
+         * where its surface is now */
+        if (new_focus == old_focus)
+        {
+            for (size_t i = 0; i + 1 < motion_samples.size(); i++)
+            {
+                const auto& sample = motion_samples[i];
+                wlr_seat_pointer_notify_motion(seat, sample.time_msec,
+                                               sx + sample.x - cursor->x,
+                                               sy + sample.y - cursor->y);
+            }
+        }
+
         wlr_seat_pointer_notify_motion(core->input->seat, time_msec, sx, sy);
     }
 
@@ -149,40 +165,63 @@ void input_manager::update_cursor_position(uint32_t time_msec, bool real_update)
     }
 }
 
+static void handle_pointer_motion_idle(void *data)
+{
+    auto input = static_cast<input_manager*> (data);
+    input->flush_pointer_motion();
+}
+
+void input_manager::queue_pointer_motion(uint32_t time_msec)
+{
+    last_cursor_event_msec = time_msec;
+    motion_samples.push_back({time_msec, cursor->x, cursor->y});
+
+    /* a mouse may report motion much more often than we can look for the
+     * surface under it, so like touch, we take all events read in one
+     * iteration of the event loop together */
+    if (!motion_source)
+        motion_source = wl_event_loop_add_idle(core->ev_loop, handle_pointer_motion_idle, this);
+}
+
+void input_manager::flush_pointer_motion()
+{
+    if (motion_source)
+        wl_event_source_remove(motion_source);
+    motion_source = nullptr;
+
+    if (motion_samples.empty())
+        return;
+
+    update_cursor_position(motion_samples.back().time_msec);
+    motion_samples.clear();
+}
+
+/* the hardware cursor is moved immediately, the rest waits for the flush */
 void input_manager::handle_pointer_motion(wlr_event_pointer_motion *ev)
 {
-    core->input->last_cursor_event_msec = ev->time_msec;
     wlr_cursor_move(cursor, ev->device, ev->delta_x, ev->delta_y);
-    update_cursor_position(ev->time_msec);
+    queue_pointer_motion(ev->time_msec);
 }
 
 void input_manager::handle_pointer_motion_absolute(wlr_event_pointer_motion_absolute *ev)
 {
-    core->input->last_cursor_event_msec = ev->time_msec;
     wlr_cursor_warp_absolute(cursor, ev->device, ev->x, ev->y);
-    update_cursor_position(ev->time_msec);;
+    queue_pointer_motion(ev->time_msec);
 }
 
 void input_manager::handle_pointer_axis(wlr_event_pointer_axis *ev)
 {
     core->input->last_cursor_event_msec = ev->time_msec;
     std::vector<axis_callback*> callbacks;
+    callbacks.swap(axis_dispatch_buffer);
+    callbacks.clear();
 
-    auto mod_state = get_modifiers();
-
-    for (auto& pair : axis_bindings)
-    {
-        auto& binding = pair.second;
-        const auto mod = binding->modifier->as_cached_key().mod;
-
-        if (binding->output == core->get_active_output() &&
-            mod_state == mod)
-            callbacks.push_back(binding->call);
-    }
-
+    axis_index.match({core->get_active_output(), get_modifiers(), 0}, callbacks);
     for (auto call : callbacks)
         (*call) (ev);
 
+    axis_dispatch_buffer.swap(callbacks);
+
     /* reset modifier bindings */
     in_mod_binding = false;
     if (active_grab)
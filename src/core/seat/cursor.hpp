@@ -2,17 +2,45 @@
 #define CURSOR_HPP
 
 #include "seat.hpp"
+#include "binding-index.hpp"
 
 struct axis_callback_data : wf_callback
 {
     axis_callback *call;
     wf_option modifier;
+
+    wf_binding_key indexed_key;
+    wf_option_callback modifier_changed;
+
+    wf_binding_key get_binding_key()
+    {
+        return {output, modifier->as_cached_key().mod, 0};
+    }
+
+    ~axis_callback_data()
+    {
+        modifier->rem_updated_handler(&modifier_changed);
+    }
 };
 
 struct button_callback_data : wf_callback
 {
     button_callback *call;
     wf_option button;
+
+    wf_binding_key indexed_key;
+    wf_option_callback button_changed;
+
+    wf_binding_key get_binding_key()
+    {
+        auto buttonb = button->as_cached_button();
+        return {output, buttonb.mod, buttonb.button};
+    }
+
+    ~button_callback_data()
+    {
+        button->rem_updated_handler(&button_changed);
+    }
 };
 
 struct wf_cursor
@@ -125,10 +125,12 @@ input_manager::input_manager()
 
         if (our_touch)
         {
-            for (auto f : our_touch->gesture_recognizer.current)
+            const auto& fingers = our_touch->gesture_recognizer.fingers;
+            for (int i = 0; i < fingers.count; i++)
             {
                 int x, y;
-                update_touch_position(get_input_time(), f.first, f.second.sx, f.second.sy, x, y);
+                update_touch_position(get_input_time(), fingers.id[i],
+                                      fingers.sx[i], fingers.sy[i], x, y);
             }
         }
     };
@@ -157,9 +159,15 @@ bool input_manager::grab_input(wayfire_grab_interface iface)
 
     assert(!active_grab); // cannot have two active input grabs!
 
+    /* motion from before the grab goes to the clients */
+    flush_pointer_motion();
+
     if (our_touch)
-        for (const auto& f : our_touch->gesture_recognizer.current)
-            handle_touch_up(0, f.first);
+    {
+        const auto& fingers = our_touch->gesture_recognizer.fingers;
+        for (int i = 0; i < fingers.count; i++)
+            handle_touch_up(0, fingers.id[i]);
+    }
 
     active_grab = iface;
 
@@ -259,6 +267,7 @@ void input_manager::rem_ ##type (int id) \
     auto it = type ## _bindings.find(id); \
     if (it != type ## _bindings.end()) \
     { \
+        type ## _index.remove(it->second); \
         delete it->second; \
         type ## _bindings.erase(it); \
     } \
@@ -273,6 +282,7 @@ void input_manager::rem_ ##type (type ## _callback *cb) \
     { \
         if (it->second->call == cb) \
         { \
+            type ## _index.remove(it->second); \
             delete it->second; \
             it = type ## _bindings.erase(it); \
         } else \
@@ -288,7 +298,11 @@ int input_manager::add_key(wf_option option, key_callback *call, wayfire_output
     kcd->key = option;
     kcd->id = ++_last_id;
 
+    kcd->key_changed = [=] () { key_index.update(kcd); };
+    option->add_updated_handler(&kcd->key_changed);
+
     key_bindings[_last_id] = kcd;
+    key_index.add(kcd);
     return _last_id;
 }
 
@@ -303,7 +317,11 @@ int input_manager::add_axis(wf_option option, axis_callback *call, wayfire_outpu
     acd->modifier = option;
     acd->id = ++_last_id;
 
+    acd->modifier_changed = [=] () { axis_index.update(acd); };
+    option->add_updated_handler(&acd->modifier_changed);
+
     axis_bindings[_last_id] = acd;
+    axis_index.add(acd);
     return _last_id;
 }
 
@@ -318,7 +336,11 @@ int input_manager::add_button(wf_option option, button_callback *call, wayfire_o
     bcd->button = option;
     bcd->id = ++_last_id;
 
+    bcd->button_changed = [=] () { button_index.update(bcd); };
+    option->add_updated_handler(&bcd->button_changed);
+
     button_bindings[_last_id] = bcd;
+    button_index.add(bcd);
     return _last_id;
 }
 
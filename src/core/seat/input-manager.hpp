@@ -6,6 +6,7 @@
 #include <vector>
 
 #include "seat.hpp"
+#include "binding-index.hpp"
 #include "plugin.hpp"
 #include "view.hpp"
 
@@ -26,6 +27,7 @@ struct button_callback_data;
 struct wlr_seat;
 
 struct wf_touch;
+struct wf_finger_table;
 struct wf_keyboard;
 
 /* TODO: most probably we want to split even more of input_manager's functionality into
@@ -65,6 +67,16 @@ class input_manager
         std::map<int, axis_callback_data*> axis_bindings;
         std::map<int, button_callback_data*> button_bindings;
 
+        /* the bindings above, indexed by (output, modifiers, key/button) */
+        wf_binding_index<key_callback_data> key_index;
+        wf_binding_index<axis_callback_data> axis_index;
+        wf_binding_index<button_callback_data> button_index;
+
+        /* reused between events, so that dispatching bindings doesn't allocate */
+        std::vector<key_callback*> key_dispatch_buffer;
+        std::vector<axis_callback*> axis_dispatch_buffer;
+        std::vector<button_callback*> button_dispatch_buffer;
+
         bool is_touch_enabled();
 
         void create_seat();
@@ -73,6 +85,19 @@ class input_manager
         void handle_input_destroyed(wlr_input_device *dev);
 
         void update_cursor_focus(wayfire_surface_t *focus, int x, int y);
+
+        /* Pointer motion read in one iteration of the event loop. The cursor
+         * is moved right away, but focus, grabs and clients are updated once,
+         * with the last position, see flush_pointer_motion() */
+        struct motion_sample
+        {
+            uint32_t time_msec;
+            double x, y;
+        };
+
+        std::vector<motion_sample> motion_samples;
+        wl_event_source *motion_source = nullptr;
+        void queue_pointer_motion(uint32_t time_msec);
         void update_touch_focus(wayfire_surface_t *focus,
                                 uint32_t time, int id, int x, int y);
         wayfire_surface_t* update_touch_position(uint32_t time, int id, int x, int y,
@@ -84,7 +109,7 @@ class input_manager
          * This might not work with multiple keyboards */
         bool in_mod_binding = false;
         int count_other_inputs = 0;
-        std::vector<key_callback*> match_keys(uint32_t mods, uint32_t key);
+        void match_keys(uint32_t mods, uint32_t key, std::vector<key_callback*>& result);
 
     public:
 
@@ -94,6 +119,10 @@ class input_manager
         int last_cursor_event_msec;
         void update_cursor_position(uint32_t time_msec, bool real_update = true);
 
+        /* handle the queued pointer motion now. Called before anything which
+         * depends on the pointer focus, so that the events stay in order */
+        void flush_pointer_motion();
+
         wl_client *exclusive_client = NULL;
 
         wlr_seat *seat = nullptr;
@@ -131,7 +160,8 @@ class input_manager
         void handle_keyboard_mod(uint32_t key, uint32_t state);
 
         void handle_touch_down  (uint32_t time, int32_t id, int32_t x, int32_t y);
-        void handle_touch_motion(uint32_t time, int32_t id, int32_t x, int32_t y);
+        /* handle the motion of all fingers during one touch frame */
+        void handle_touch_motion(uint32_t time, const wf_finger_table& fingers);
         void handle_touch_up    (uint32_t time, int32_t id);
 
         void handle_gesture(wayfire_touch_gesture g);
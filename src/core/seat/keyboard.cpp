@@ -22,6 +22,7 @@ static void handle_keyboard_key_cb(wl_listener* listener, void *data)
 {
     auto ev = static_cast<wlr_event_keyboard_key*> (data);
     wf_keyboard::listeners *lss = wl_container_of(listener, lss, key);
+    core->input->flush_pointer_motion();
 
     auto seat = core->get_current_seat();
     wlr_seat_set_keyboard(seat, lss->keyboard->device);
@@ -39,6 +40,7 @@ static void handle_keyboard_mod_cb(wl_listener* listener, void* data)
 {
     auto kbd = static_cast<wlr_keyboard*> (data);
     wf_keyboard::listeners *lss = wl_container_of(listener, lss, modifier);
+    core->input->flush_pointer_motion();
 
     auto seat = core->get_current_seat();
     wlr_seat_set_keyboard(seat, lss->keyboard->device);
@@ -141,20 +143,10 @@ static bool check_vt_switch(wlr_session *session, uint32_t key, uint32_t mods)
     return true;
 }
 
-std::vector<key_callback*> input_manager::match_keys(uint32_t mod_state, uint32_t key)
+void input_manager::match_keys(uint32_t mod_state, uint32_t key,
+                               std::vector<key_callback*>& result)
 {
-    std::vector<key_callback*> callbacks;
-
-    for (auto& pair : key_bindings)
-    {
-        auto& binding = pair.second;
-        const auto keyb = binding->key->as_cached_key();
-        if (binding->output == core->get_active_output() &&
-            mod_state == keyb.mod && key == keyb.keyval)
-            callbacks.push_back(binding->call);
-    }
-
-    return callbacks;
+    key_index.match({core->get_active_output(), mod_state, key}, result);
 }
 
 static uint32_t mod_from_key(uint32_t key)
@@ -180,13 +172,21 @@ bool input_manager::handle_keyboard_key(uint32_t key, uint32_t state)
     if (mod)
         handle_keyboard_mod(mod, state);
 
+    /* take over the preallocated buffer, a binding might cause another
+     * key event to be processed before we are done with it */
     std::vector<key_callback*> callbacks;
+    callbacks.swap(key_dispatch_buffer);
+    callbacks.clear();
+
     auto kbd = wlr_seat_get_keyboard(seat);
 
     if (state == WLR_KEY_PRESSED)
     {
         if (check_vt_switch(wlr_multi_get_session(core->backend), key, get_modifiers()))
+        {
+            key_dispatch_buffer.swap(callbacks);
             return true;
+        }
 
         /* as long as we have pressed only modifiers, we should check for modifier bindings on release */
         if (mod)
@@ -205,11 +205,11 @@ bool input_manager::handle_keyboard_key(uint32_t key, uint32_t state)
             in_mod_binding = false;
         }
 
-        callbacks = match_keys(get_modifiers(), key);
+        match_keys(get_modifiers(), key, callbacks);
     } else
     {
         if (in_mod_binding)
-            callbacks = match_keys(get_modifiers() | mod, 0);
+            match_keys(get_modifiers() | mod, 0, callbacks);
 
         in_mod_binding = false;
     }
@@ -217,7 +217,10 @@ bool input_manager::handle_keyboard_key(uint32_t key, uint32_t state)
     for (auto call : callbacks)
         (*call) (key);
 
-    return active_grab || !callbacks.empty();
+    bool handled = active_grab || !callbacks.empty();
+    key_dispatch_buffer.swap(callbacks);
+
+    return handled;
 }
 
 void input_manager::handle_keyboard_mod(uint32_t modifier, uint32_t state)
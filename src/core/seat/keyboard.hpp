@@ -3,6 +3,7 @@
 
 #include "config.hpp"
 #include "seat.hpp"
+#include "binding-index.hpp"
 
 extern "C"
 {
@@ -35,6 +36,20 @@ struct key_callback_data : wf_callback
 {
     key_callback *call;
     wf_option key;
+
+    wf_binding_key indexed_key;
+    wf_option_callback key_changed;
+
+    wf_binding_key get_binding_key()
+    {
+        auto keyb = key->as_cached_key();
+        return {output, keyb.mod, keyb.keyval};
+    }
+
+    ~key_callback_data()
+    {
+        key->rem_updated_handler(&key_changed);
+    }
 };
 
 #endif /* end of include guard: KEYBOARD_HPP */
@@ -12,28 +12,82 @@ constexpr static int MIN_SWIPE_DISTANCE = 100;
 constexpr static float MIN_PINCH_DISTANCE = 70;
 constexpr static int EDGE_SWIPE_THRESHOLD = 50;
 
-void wf_gesture_recognizer::reset_gesture()
+int wf_finger_table::find(int32_t id) const
 {
-    gesture_emitted = false;
+    for (int i = 0; i < count; i++)
+    {
+        if (this->id[i] == id)
+            return i;
+    }
+
+    return -1;
+}
 
-    int cx = 0, cy = 0;
-    for (auto f : current)
+int wf_finger_table::add(int32_t id, int x, int y)
+{
+    if (count == capacity)
+        return -1;
+
+    int i = count++;
+    this->id[i] = id;
+    sx[i] = ix[i] = x;
+    sy[i] = iy[i] = y;
+    moved[i] = false;
+
+    return i;
+}
+
+void wf_finger_table::remove(int index)
+{
+    /* the order of the fingers doesn't matter, so just move the last one
+     * in place of the removed finger */
+    int last = --count;
+
+    id[index] = id[last];
+    sx[index] = sx[last];
+    sy[index] = sy[last];
+    ix[index] = ix[last];
+    iy[index] = iy[last];
+    moved[index] = moved[last];
+}
+
+void wf_gesture_recognizer::get_center(int& cx, int& cy)
+{
+    cx = cy = 0;
+    for (int i = 0; i < fingers.count; i++)
     {
-        cx += f.second.sx;
-        cy += f.second.sy;
+        cx += fingers.sx[i];
+        cy += fingers.sy[i];
     }
 
-    cx /= current.size();
-    cy /= current.size();
+    cx /= fingers.count;
+    cy /= fingers.count;
+}
 
-    start_sum_dist = 0;
-    for (auto &f : current)
+float wf_gesture_recognizer::get_sum_dist(int cx, int cy)
+{
+    float sum_dist = 0;
+    for (int i = 0; i < fingers.count; i++)
     {
-        start_sum_dist += std::sqrt((cx - f.second.sx) * (cx - f.second.sx)
-                                  + (cy - f.second.sy) * (cy - f.second.sy));
+        float dx = cx - fingers.sx[i], dy = cy - fingers.sy[i];
+        sum_dist += std::sqrt(dx * dx + dy * dy);
+    }
 
-        f.second.ix = f.second.sx;
-        f.second.iy = f.second.sy;
+    return sum_dist;
+}
+
+void wf_gesture_recognizer::reset_gesture()
+{
+    gesture_emitted = false;
+
+    int cx, cy;
+    get_center(cx, cy);
+    start_sum_dist = get_sum_dist(cx, cy);
+
+    for (int i = 0; i < fingers.count; i++)
+    {
+        fingers.ix[i] = fingers.sx[i];
+        fingers.iy[i] = fingers.sy[i];
     }
 }
 
@@ -42,10 +96,10 @@ void wf_gesture_recognizer::start_new_gesture(int reason_id, int time)
     in_gesture = true;
     reset_gesture();
 
-    for (auto &f : current)
+    for (int i = 0; i < fingers.count; i++)
     {
-        if (f.first != reason_id)
-            core->input->handle_touch_up(time, f.first);
+        if (fingers.id[i] != reason_id)
+            core->input->handle_touch_up(time, fingers.id[i]);
     }
 }
 
@@ -54,7 +108,7 @@ void wf_gesture_recognizer::stop_gesture()
     in_gesture = gesture_emitted = false;
 }
 
-void wf_gesture_recognizer::continue_gesture(int id, int sx, int sy)
+void wf_gesture_recognizer::continue_gesture()
 {
     if (gesture_emitted)
         return;
@@ -65,9 +119,10 @@ void wf_gesture_recognizer::continue_gesture(int id, int sx, int sy)
     bool is_left_swipe = true, is_right_swipe = true,
          is_up_swipe = true, is_down_swipe = true;
 
-    for (auto f : current) {
-        int dx = f.second.sx - f.second.ix;
-        int dy = f.second.sy - f.second.iy;
+    for (int i = 0; i < fingers.count; i++)
+    {
+        int dx = fingers.sx[i] - fingers.ix[i];
+        int dy = fingers.sy[i] - fingers.iy[i];
 
         if (-MIN_SWIPE_DISTANCE < dx)
             is_left_swipe = false;
@@ -94,7 +149,7 @@ void wf_gesture_recognizer::continue_gesture(int id, int sx, int sy)
     {
         wayfire_touch_gesture gesture;
         gesture.type = GESTURE_SWIPE;
-        gesture.finger_count = current.size();
+        gesture.finger_count = fingers.count;
         gesture.direction = swipe_dir;
 
         bool bottom_edge = false, upper_edge = false,
@@ -102,12 +157,12 @@ void wf_gesture_recognizer::continue_gesture(int id, int sx, int sy)
 
         auto og = core->get_active_output()->get_full_geometry();
 
-        for (auto f : current)
+        for (int i = 0; i < fingers.count; i++)
         {
-            bottom_edge |= (f.second.iy >= og.y + og.height - EDGE_SWIPE_THRESHOLD);
-            upper_edge  |= (f.second.iy <= og.y + EDGE_SWIPE_THRESHOLD);
-            left_edge   |= (f.second.ix <= og.x + EDGE_SWIPE_THRESHOLD);
-            right_edge  |= (f.second.ix >= og.x + og.width - EDGE_SWIPE_THRESHOLD);
+            bottom_edge |= (fingers.iy[i] >= og.y + og.height - EDGE_SWIPE_THRESHOLD);
+            upper_edge  |= (fingers.iy[i] <= og.y + EDGE_SWIPE_THRESHOLD);
+            left_edge   |= (fingers.ix[i] <= og.x + EDGE_SWIPE_THRESHOLD);
+            right_edge  |= (fingers.ix[i] >= og.x + og.width - EDGE_SWIPE_THRESHOLD);
         }
 
         uint32_t edge_swipe_dir = 0;
@@ -132,20 +187,9 @@ void wf_gesture_recognizer::continue_gesture(int id, int sx, int sy)
      * We calculate the central point of the fingers (cx, cy),
      * then we measure the average distance to the center. If it
      * is bigger/smaller above/below some threshold, then we emit the gesture */
-    int cx = 0, cy = 0;
-    for (auto f : current) {
-        cx += f.second.sx;
-        cy += f.second.sy;
-    }
-
-    cx /= current.size();
-    cy /= current.size();
-
-    int sum_dist = 0;
-    for (auto f : current) {
-        sum_dist += std::sqrt((cx - f.second.sx) * (cx - f.second.sx)
-                              + (cy - f.second.sy) * (cy - f.second.sy));
-    }
+    int cx, cy;
+    get_center(cx, cy);
+    float sum_dist = get_sum_dist(cx, cy);
 
     bool inward_pinch  = (start_sum_dist - sum_dist >= MIN_PINCH_DISTANCE);
     bool outward_pinch = (start_sum_dist - sum_dist <= -MIN_PINCH_DISTANCE);
@@ -153,7 +197,7 @@ void wf_gesture_recognizer::continue_gesture(int id, int sx, int sy)
     if (inward_pinch || outward_pinch) {
         wayfire_touch_gesture gesture;
         gesture.type = GESTURE_PINCH;
-        gesture.finger_count = current.size();
+        gesture.finger_count = fingers.count;
         gesture.direction =
             (inward_pinch ? GESTURE_DIRECTION_IN : GESTURE_DIRECTION_OUT);
 
@@ -162,27 +206,80 @@ void wf_gesture_recognizer::continue_gesture(int id, int sx, int sy)
     }
 }
 
-void wf_gesture_recognizer::update_touch(int32_t time, int id, int sx, int sy)
+static void handle_touch_frame_idle(void *data)
+{
+    auto recognizer = static_cast<wf_gesture_recognizer*> (data);
+
+    /* the idle source is destroyed after it has been dispatched */
+    recognizer->frame_source = nullptr;
+    recognizer->handle_frame();
+}
+
+void wf_gesture_recognizer::handle_frame()
 {
-    current[id].sx = sx;
-    current[id].sy = sy;
+    if (frame_source)
+    {
+        wl_event_source_remove(frame_source);
+        frame_source = nullptr;
+    }
+
+    bool any_moved = false;
+    for (int i = 0; i < fingers.count; i++)
+        any_moved |= fingers.moved[i];
 
+    if (!any_moved)
+        return;
+
+    /* the gesture is checked once with the final positions of all fingers,
+     * instead of once for each finger which has moved */
     if (in_gesture)
     {
-        continue_gesture(id, sx, sy);
+        continue_gesture();
     } else
     {
-        core->input->handle_touch_motion(time, id, sx, sy);
+        core->input->handle_touch_motion(frame_time, fingers);
     }
+
+    for (int i = 0; i < fingers.count; i++)
+        fingers.moved[i] = false;
+}
+
+void wf_gesture_recognizer::update_touch(int32_t time, int id, int sx, int sy)
+{
+    int i = fingers.find(id);
+    if (i < 0)
+        return;
+
+    fingers.sx[i] = sx;
+    fingers.sy[i] = sy;
+    fingers.moved[i] = true;
+    frame_time = time;
+
+    /* wlroots doesn't tell us where a touch frame ends, so we consider
+     * all events read in one iteration of the event loop as one frame */
+    if (!frame_source)
+        frame_source = wl_event_loop_add_idle(core->ev_loop, handle_touch_frame_idle, this);
 }
 
 void wf_gesture_recognizer::register_touch(int time, int id, int sx, int sy)
 {
-    current[id] = {id, sx, sy, sx, sy};
+    /* the other fingers must be at their current positions when
+     * a gesture starts */
+    handle_frame();
+
+    if (fingers.find(id) >= 0)
+        return;
+
+    if (fingers.add(id, sx, sy) < 0)
+    {
+        log_error("too many touch points, ignoring touch %d", id);
+        return;
+    }
+
     if (in_gesture)
         reset_gesture();
 
-    if (current.size() >= MIN_FINGERS && !in_gesture)
+    if (fingers.count >= MIN_FINGERS && !in_gesture)
         start_new_gesture(id, time);
 
     if (!in_gesture)
@@ -191,14 +288,19 @@ void wf_gesture_recognizer::register_touch(int time, int id, int sx, int sy)
 
 void wf_gesture_recognizer::unregister_touch(int32_t time, int32_t id)
 {
+    int i = fingers.find(id);
+
     /* shouldn't happen, except possibly in nested(wayland/x11) backend */
-    if (!current.count(id))
+    if (i < 0)
         return;
 
-    current.erase(id);
+    /* clients must see the last motion before the touch goes up */
+    handle_frame();
+
+    fingers.remove(i);
     if (in_gesture)
     {
-        if (current.size() < MIN_FINGERS)
+        if (fingers.count < MIN_FINGERS)
             stop_gesture();
         else
             reset_gesture();
@@ -209,10 +311,17 @@ void wf_gesture_recognizer::unregister_touch(int32_t time, int32_t id)
     }
 }
 
+wf_gesture_recognizer::~wf_gesture_recognizer()
+{
+    if (frame_source)
+        wl_event_source_remove(frame_source);
+}
+
 static void handle_touch_down(wl_listener* listener, void *data)
 {
     auto ev = static_cast<wlr_event_touch_down*> (data);
     auto touch = static_cast<wf_touch*> (ev->device->data);
+    core->input->flush_pointer_motion();
 
     double lx, ly;
     wlr_cursor_absolute_to_layout_coords(core->input->cursor,
@@ -226,6 +335,7 @@ static void handle_touch_up(wl_listener* listener, void *data)
 {
     auto ev = static_cast<wlr_event_touch_up*> (data);
     auto touch = static_cast<wf_touch*> (ev->device->data);
+    core->input->flush_pointer_motion();
 
     touch->gesture_recognizer.unregister_touch(ev->time_msec, ev->touch_id);
     wlr_idle_notify_activity(core->protocols.idle, core->get_current_seat());
@@ -354,21 +464,100 @@ void input_manager::handle_touch_up(uint32_t time, int32_t id)
     wlr_seat_touch_notify_up(seat, time, id);
 }
 
-void input_manager::handle_touch_motion(uint32_t time, int32_t id, int32_t x, int32_t y)
+void input_manager::handle_touch_motion(uint32_t time, const wf_finger_table& fingers)
 {
     if (active_grab)
     {
-        auto wo = core->get_output_at(x, y);
-        auto og = wo->get_full_geometry();
-        if (active_grab->callbacks.touch.motion)
-            active_grab->callbacks.touch.motion(id, x - og.x, y - og.y);
+        if (!active_grab->callbacks.touch.motion)
+            return;
+
+        for (int i = 0; i < fingers.count; i++)
+        {
+            if (!fingers.moved[i])
+                continue;
+
+            auto wo = core->get_output_at(fingers.sx[i], fingers.sy[i]);
+            auto og = wo->get_full_geometry();
+            active_grab->callbacks.touch.motion(fingers.id[i],
+                fingers.sx[i] - og.x, fingers.sy[i] - og.y);
+        }
 
         return;
     }
 
-    int sx, sy;
-    update_touch_position(time, id, x, y, sx, sy);
-    wlr_seat_touch_notify_motion(seat, time, id, sx, sy);
+    /* resolve the focus of all moved fingers with a single pass over the
+     * views of each output, fingers are usually on the same output */
+    wayfire_surface_t *focus[wf_finger_table::capacity];
+    int local_x[wf_finger_table::capacity], local_y[wf_finger_table::capacity];
+    bool resolved[wf_finger_table::capacity];
+
+    for (int i = 0; i < fingers.count; i++)
+    {
+        focus[i] = nullptr;
+        local_x[i] = local_y[i] = 0;
+        resolved[i] = !fingers.moved[i];
+    }
+
+    for (int i = 0; i < fingers.count; i++)
+    {
+        if (resolved[i])
+            continue;
+
+        auto wo = core->get_output_at(fingers.sx[i], fingers.sy[i]);
+        auto og = wo->get_full_geometry();
+
+        int output_fingers[wf_finger_table::capacity], count = 0;
+        for (int j = i; j < fingers.count; j++)
+        {
+            if (resolved[j] ||
+                core->get_output_at(fingers.sx[j], fingers.sy[j]) != wo)
+                continue;
+
+            output_fingers[count++] = j;
+            resolved[j] = true;
+        }
+
+        int remaining = count;
+        wo->workspace->for_each_view(
+            [&] (wayfire_view view)
+            {
+                if (!remaining || !can_focus_surface(view.get()))
+                    return;
+
+                for (int k = 0; k < count; k++)
+                {
+                    int j = output_fingers[k];
+                    if (focus[j])
+                        continue;
+
+                    focus[j] = view->map_input_coordinates(
+                        fingers.sx[j] - og.x, fingers.sy[j] - og.y,
+                        local_x[j], local_y[j]);
+
+                    if (focus[j])
+                        --remaining;
+                }
+            }, WF_ALL_LAYERS);
+    }
+
+    for (int i = 0; i < fingers.count; i++)
+    {
+        if (!fingers.moved[i])
+            continue;
+
+        auto og = core->get_output_at(fingers.sx[i], fingers.sy[i])->get_full_geometry();
+        update_touch_focus(focus[i], time, fingers.id[i],
+                           fingers.sx[i] - og.x, fingers.sy[i] - og.y);
+
+        wlr_seat_touch_notify_motion(seat, time, fingers.id[i],
+                                     local_x[i], local_y[i]);
+    }
+
+    for (auto& icon : drag_icons)
+    {
+        if (icon->is_mapped())
+            icon->update_output_position();
+    }
 }
 
 void input_manager::check_touch_bindings(int x, int y)
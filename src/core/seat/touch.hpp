@@ -1,36 +1,67 @@
 #ifndef TOUCH_HPP
 #define TOUCH_HPP
 
-#include <map>
+#include <cstdint>
 
 extern "C"
 {
 #include <wlr/types/wlr_cursor.h>
 }
 
-struct wf_gesture_recognizer
+struct wl_event_source;
+
+/* The fingers currently on the screen. The table has a fixed capacity and
+ * keeps each attribute in its own array, because gesture recognition always
+ * looks at all fingers at once */
+struct wf_finger_table
 {
-    struct finger
-    {
-        int id;
-        int sx, sy;
-        int ix, iy;
-    };
+    static constexpr int capacity = 16;
+
+    int count = 0;
+    int32_t id[capacity];
 
-    std::map<int, finger> current;
+    /* current position, in layout coordinates */
+    int sx[capacity], sy[capacity];
+    /* position at the start of the current gesture */
+    int ix[capacity], iy[capacity];
+    /* the finger has moved since the last touch frame */
+    bool moved[capacity];
 
+    /* returns the index of the finger with the given id, or -1 */
+    int find(int32_t id) const;
+    /* returns the index of the new finger, or -1 if the table is full */
+    int add(int32_t id, int x, int y);
+    void remove(int index);
+};
+
+struct wf_gesture_recognizer
+{
+    wf_finger_table fingers;
+
+    /* Motion is only recorded here and processed once per touch frame,
+     * that is after all events the backend has read in one go */
     void update_touch(int32_t time, int id, int sx, int sy);
 
     void register_touch(int time, int id, int sx, int sy);
     void unregister_touch(int32_t time, int32_t id);
 
+    /* process the motion since the last frame, NOT API */
+    void handle_frame();
+    wl_event_source *frame_source = nullptr;
+
+    ~wf_gesture_recognizer();
+
 private:
 
     bool in_gesture = false, gesture_emitted = false;
-    int start_sum_dist;
+    float start_sum_dist;
+    uint32_t frame_time;
+
+    void get_center(int& cx, int& cy);
+    float get_sum_dist(int cx, int cy);
 
     void start_new_gesture(int reason_id, int time);
-    void continue_gesture(int id, int sx, int sy);
+    void continue_gesture();
     void stop_gesture();
     void reset_gesture();
 };
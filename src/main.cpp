@@ -22,6 +22,7 @@ extern "C"
 
 #include "core.hpp"
 #include "output.hpp"
+#include "core/launcher.hpp"
 
 wf_runtime_config runtime_config;
 
@@ -164,15 +165,19 @@ int main(int argc, char *argv[])
 
     log_info("Starting wayfire");
 
+    log_info("using config file: %s", config_file.c_str());
+    auto config = new wayfire_config(config_file);
+
+    /* fork the launcher helper while we are still small */
+    launcher::start_helper(config);
+
     core = new wayfire_core();
+    core->config   = config;
     core->display  = wl_display_create();
     core->ev_loop  = wl_display_get_event_loop(core->display);
     core->backend  = wlr_backend_autocreate(core->display, add_egl_depth_renderer);
     core->renderer = wlr_backend_get_renderer(core->backend);
 
-    log_info("using config file: %s", config_file.c_str());
-    core->config = new wayfire_config(config_file);
-
     int inotify_fd = inotify_init();
     reload_config(inotify_fd);
 
@@ -5,8 +5,11 @@
 #include "../core/seat/input-manager.hpp"
 #include "opengl.hpp"
 #include "debug.hpp"
+#include "software-renderer.hpp"
 #include "../main.hpp"
 #include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
 
 extern "C"
 {
@@ -16,6 +19,7 @@ extern "C"
 #undef static
 #include <wlr/types/wlr_output_damage.h>
 #include <wlr/util/region.h>
+#include <wlr/backend/headless.h>
 }
 
 #include "view/priv-view.hpp"
@@ -23,6 +27,8 @@ extern "C"
 struct wf_output_damage
 {
     pixman_region32_t frame_damage;
+    /* damage which is the same on every workspace, relative to the output */
+    pixman_region32_t shell_damage;
     wlr_output *output;
     wlr_output_damage *damage_manager;
 
@@ -30,6 +36,7 @@ struct wf_output_damage
     {
         this->output = output;
         pixman_region32_init(&frame_damage);
+        pixman_region32_init(&shell_damage);
         damage_manager = wlr_output_damage_create(output);
     }
 
@@ -41,11 +48,18 @@ struct wf_output_damage
     }
 
     void add(const wlr_box& box)
+    {
+        add(box, box);
+    }
+
+    /* box is in workspace coordinates, screen_box is where it is shown
+     * on the screen, they differ only when the screen is zoomed */
+    void add(const wlr_box& box, const wlr_box& screen_box)
     {
         pixman_region32_union_rect(&frame_damage, &frame_damage,
                                    box.x, box.y, box.width, box.height);
 
-        auto sbox = box;
+        auto sbox = screen_box;
         wlr_output_damage_add_box(damage_manager, &sbox);
         schedule_repaint();
     }
@@ -83,6 +97,7 @@ struct wf_output_damage
     {
         wlr_output_damage_swap_buffers(damage_manager, when, swap_damage);
         pixman_region32_clear(&frame_damage);
+        pixman_region32_clear(&shell_damage);
     }
 
     void schedule_repaint()
@@ -98,7 +113,31 @@ void frame_cb (wl_listener*, void *data)
 
     auto output = core->get_output(output_damage->output);
     assert(output);
-    output->render->paint();
+    output->render->handle_frame();
+}
+
+void scanout_surface_destroy_cb(wl_listener*, void *data)
+{
+    auto surface = static_cast<wlr_surface*>(data);
+    core->for_each_output([=] (wayfire_output *output)
+    {
+        if (output->render->scanout_surface == surface)
+            output->render->set_scanout_surface(nullptr, WF_SCANOUT_NO_FULLSCREEN);
+    });
+}
+
+int delayed_paint_cb(void *data)
+{
+    auto rm = (render_manager*) data;
+    assert(rm);
+
+    rm->paint_scheduled = false;
+    rm->paint();
+
+    /* paint() might have returned early, without calling post_paint() */
+    rm->frame_done_sent = false;
+
+    return 0;
 }
 
 render_manager::render_manager(wayfire_output *o)
@@ -114,9 +153,85 @@ render_manager::render_manager(wayfire_output *o)
 
     pixman_region32_init(&frame_damage);
 
+    auto section = core->config->get_section(output->handle->name);
+    render_delay_opt = section->get_option("render_delay", "off");
+    render_delay_margin_opt = section->get_option("render_delay_margin", "2");
+
+    /* "auto" uses the software renderer only where there is no real GPU */
+    auto software = section->get_option("software_renderer", "auto")->as_string();
+    if (software == "on" ||
+        (software == "auto" && wlr_output_is_headless(output->handle)))
+    {
+        log_info("using the software renderer on output %s", output->handle->name);
+        software_renderer = std::unique_ptr<wf_software_renderer>(
+            new wf_software_renderer(output));
+    }
+
+    /* only the pixman composition of the software renderer is threaded.
+     * GL outputs render on the main thread, with the wlroots renderer */
+    pixman_region32_init(&threaded_damage);
+    render_thread_enabled = software_renderer &&
+        section->get_option("render_thread", "0")->as_int();
+
+    direct_scanout_enabled = section->get_option("direct_scanout", "1")->as_int();
+    scanout_surface_destroy.notify = scanout_surface_destroy_cb;
+    wl_list_init(&scanout_surface_destroy.link);
+
+    paint_durations.fill(0);
+    delayed_paint_source = wl_event_loop_add_timer(core->ev_loop, delayed_paint_cb, this);
+
     schedule_redraw();
 }
 
+static inline int64_t timespec_to_usec(const timespec& ts)
+{
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int render_manager::get_render_delay()
+{
+    auto mode = render_delay_opt->as_string();
+    if (mode == "off" || mode.empty() || output->handle->refresh <= 0)
+        return 0;
+
+    /* refresh is in mHz */
+    int64_t frame_time = (int64_t)1000000000 / output->handle->refresh;
+    int64_t margin = (int64_t)render_delay_margin_opt->as_int() * 1000;
+
+    int64_t delay;
+    if (mode == "auto")
+    {
+        /* be pessimistic, a missed vblank costs much more than a slightly
+         * earlier paint */
+        int64_t predicted = *std::max_element(paint_durations.begin(),
+                                              paint_durations.end());
+        delay = frame_time - predicted - margin;
+    } else
+    {
+        delay = std::min((int64_t)render_delay_opt->as_int() * 1000, frame_time - margin);
+    }
+
+    return std::max(delay / 1000, (int64_t)0);
+}
+
+void render_manager::handle_frame()
+{
+    /* we already got a frame event and are waiting to paint */
+    if (paint_scheduled)
+        return;
+
+    int delay = get_render_delay();
+    if (delay <= 0)
+        return paint();
+
+    /* let clients render their next frame while we wait */
+    send_frame_done();
+    frame_done_sent = true;
+
+    paint_scheduled = true;
+    wl_event_source_timer_update(delayed_paint_source, delay);
+}
+
 void render_manager::init_default_streams()
 {
     GetTuple(vw, vh, output->workspace->get_workspace_grid_size());
@@ -151,19 +266,168 @@ void render_manager::release_context()
 render_manager::~render_manager()
 {
     wl_list_remove(&frame_listener.link);
+    wl_list_remove(&scanout_surface_destroy.link);
 
     if (idle_redraw_source)
         wl_event_source_remove(idle_redraw_source);
     if (idle_damage_source)
         wl_event_source_remove(idle_damage_source);
+    wl_event_source_remove(delayed_paint_source);
 
     pixman_region32_fini(&frame_damage);
+    pixman_region32_fini(&threaded_damage);
+    software_renderer.reset();
+    release_post_targets();
     release_context();
 }
 
+bool render_manager::uses_software_renderer()
+{
+    return software_renderer != nullptr;
+}
+
+const wf_scanout_stats& render_manager::get_scanout_stats()
+{
+    return scanout_stats;
+}
+
+static const char *scanout_result_names[] = {
+    "ok", "disabled", "effects", "drag icon", "no fullscreen view",
+    "transformed view", "subsurfaces", "geometry", "not opaque"
+};
+
+wf_scanout_result render_manager::check_direct_scanout(wlr_surface*& surface)
+{
+    surface = nullptr;
+    if (!direct_scanout_enabled)
+        return WF_SCANOUT_DISABLED;
+
+    /* anything we draw on top of or instead of the views */
+    if (renderer || output_inhibit || is_viewport_zoomed() ||
+        runtime_config.damage_debug || !post_effects.empty() || !captures.empty())
+    {
+        return WF_SCANOUT_EFFECTS;
+    }
+
+    for (auto& container : effects)
+    {
+        if (!container.empty())
+            return WF_SCANOUT_EFFECTS;
+    }
+
+    for (auto& icon : core->input->drag_icons)
+    {
+        if (icon->is_mapped())
+            return WF_SCANOUT_DRAG_ICON;
+    }
+
+    /* the top-most visible view must be the fullscreen one */
+    auto views = output->workspace->get_views_on_workspace(
+        output->workspace->get_current_workspace(), WF_ALL_LAYERS, false);
+
+    wayfire_view top = nullptr;
+    for (auto& view : views)
+    {
+        if (view->is_visible())
+        {
+            top = view;
+            break;
+        }
+    }
+
+    if (!top || !top->fullscreen || !top->is_mapped() || !top->get_buffer())
+        return WF_SCANOUT_NO_FULLSCREEN;
+
+    if (top->has_transformer() || top->frozen || top->alpha < 0.999f)
+        return WF_SCANOUT_TRANSFORMED;
+
+    /* includes the decoration */
+    int surfaces = 0;
+    top->for_each_surface([&] (wayfire_surface_t*, int, int) { ++surfaces; });
+    if (surfaces > 1)
+        return WF_SCANOUT_SUBSURFACES;
+
+    auto wlr_surf = top->surface;
+    auto& state = wlr_surf->current;
+    if (top->get_output_geometry() != output->get_relative_geometry() ||
+        state.scale != output->handle->scale ||
+        state.transform != output->handle->transform)
+    {
+        return WF_SCANOUT_GEOMETRY;
+    }
+
+    pixman_box32_t box = {0, 0, state.width, state.height};
+    if (pixman_region32_contains_rectangle(&state.opaque, &box) != PIXMAN_REGION_IN)
+        return WF_SCANOUT_NOT_OPAQUE;
+
+    surface = wlr_surf;
+    return WF_SCANOUT_OK;
+}
+
+void render_manager::set_scanout_surface(wlr_surface *surface,
+                                         wf_scanout_result result)
+{
+    if (surface == scanout_surface)
+        return;
+
+    if (surface)
+    {
+        log_info("output %s: direct scanout started", output->handle->name);
+        ++scanout_stats.activations;
+    } else
+    {
+        log_info("output %s: direct scanout stopped (%s)", output->handle->name,
+                 scanout_result_names[result]);
+    }
+
+    scanout_surface = surface;
+    wlr_output_set_fullscreen_surface(output->handle, surface);
+
+    wl_list_remove(&scanout_surface_destroy.link);
+    wl_list_init(&scanout_surface_destroy.link);
+    if (surface)
+        wl_signal_add(&surface->events.destroy, &scanout_surface_destroy);
+
+    if (surface && software_renderer)
+        software_renderer->invalidate();
+
+    /* we haven't painted anything while scanning out */
+    if (!surface)
+    {
+        int w, h;
+        wlr_output_transformed_resolution(output->handle, &w, &h);
+        pixman_region32_union_rect(&frame_damage, &frame_damage, 0, 0, w, h);
+        output_damage->add();
+    }
+}
+
+bool render_manager::is_viewport_zoomed()
+{
+    /* custom renderers draw the whole output on their own */
+    return viewport_zoom != 1.0 && !renderer;
+}
+
+wlr_box render_manager::get_zoomed_box(const wlr_box& box)
+{
+    const float scale = output->handle->scale;
+    const float ox = viewport_zoom_x * scale, oy = viewport_zoom_y * scale;
+
+    int x1 = std::floor((box.x - ox) * viewport_zoom);
+    int y1 = std::floor((box.y - oy) * viewport_zoom);
+    int x2 = std::ceil((box.x + box.width - ox) * viewport_zoom);
+    int y2 = std::ceil((box.y + box.height - oy) * viewport_zoom);
+
+    return {x1, y1, x2 - x1, y2 - y1};
+}
+
 void render_manager::damage(const wlr_box& box)
 {
-    if (!output->destroyed)
+    if (output->destroyed)
+        return;
+
+    if (is_viewport_zoomed())
+        output_damage->add(box, get_zoomed_box(box));
+    else
         output_damage->add(box);
 }
 
@@ -172,10 +436,33 @@ void render_manager::damage(pixman_region32_t *region)
     if (output->destroyed)
         return;
 
-    if (region)
-        output_damage->add(region);
-    else
-        output_damage->add();
+    if (!region)
+        return output_damage->add();
+
+    if (!is_viewport_zoomed())
+        return output_damage->add(region);
+
+    int n_rect;
+    auto rects = pixman_region32_rectangles(region, &n_rect);
+    for (int i = 0; i < n_rect; i++)
+        damage(wlr_box_from_pixman_box(rects[i]));
+}
+
+void render_manager::set_viewport_zoom(float zoom, int x, int y)
+{
+    zoom = std::max(zoom, 1.0f);
+    if (zoom == 1.0)
+        x = y = 0;
+
+    if (zoom == viewport_zoom && x == viewport_zoom_x && y == viewport_zoom_y)
+        return;
+
+    viewport_zoom = zoom;
+    viewport_zoom_x = x;
+    viewport_zoom_y = y;
+
+    /* everything on the screen moves */
+    damage(NULL);
 }
 
 void redraw_idle_cb(void *data)
@@ -218,6 +505,47 @@ void render_manager::schedule_redraw()
         idle_redraw_source = wl_event_loop_add_idle(core->ev_loop, redraw_idle_cb, output);
 }
 
+void render_manager::damage_all_workspaces(pixman_region32_t *region)
+{
+    if (output->destroyed)
+        return;
+
+    /* the current workspace gets it as usual, the others when they are
+     * painted, see get_ws_damage() */
+    damage(region);
+    pixman_region32_union(&output_damage->shell_damage,
+                          &output_damage->shell_damage, region);
+}
+
+void render_manager::queue_view_damage(wayfire_view_t *view)
+{
+    damaged_views.push_back(view);
+    schedule_redraw();
+}
+
+/* only needed when a view leaves the output or is destroyed, the views
+ * flushed while painting have already been taken out of the queue */
+void render_manager::dequeue_view_damage(wayfire_view_t *view)
+{
+    auto it = std::find(damaged_views.begin(), damaged_views.end(), view);
+    if (it != damaged_views.end())
+    {
+        std::swap(*it, damaged_views.back());
+        damaged_views.pop_back();
+    }
+}
+
+/* views collect their damage while we handle events, and give it to the
+ * output here, once per frame */
+void render_manager::flush_view_damage()
+{
+    auto views = std::move(damaged_views);
+    damaged_views.clear();
+
+    for (auto view : views)
+        view->flush_damage();
+}
+
 /* return damage from this frame for the given workspace, coordinates relative to the workspace */
 void render_manager::get_ws_damage(std::tuple<int, int> ws, pixman_region32_t *out_damage)
 {
@@ -237,6 +565,12 @@ void render_manager::get_ws_damage(std::tuple<int, int> ws, pixman_region32_t *o
                                    sw, sh);
 
     pixman_region32_translate(out_damage, (cx - vx) * sw, (cy - vy) * sh);
+
+    pixman_region32_t shell_damage;
+    pixman_region32_init(&shell_damage);
+    pixman_region32_intersect_rect(&shell_damage, &output_damage->shell_damage, 0, 0, sw, sh);
+    pixman_region32_union(out_damage, out_damage, &shell_damage);
+    pixman_region32_fini(&shell_damage);
 }
 
 void damage_idle_cb(void *data)
@@ -274,21 +608,114 @@ static inline int64_t timespec_to_msec(const struct timespec *a) {
 struct render_manager::wf_post_effect
 {
     post_hook_t *hook;
+    bool damage_local = false;
     bool to_remove = false;
-    GLuint target_fbo = 0, target_tex = 0;
 };
 
+void render_manager::release_post_targets()
+{
+    for (auto& target : post_targets)
+    {
+        if (target.fb == (uint32_t)-1)
+            continue;
+
+        OpenGL::bind_context(ctx);
+        OpenGL::release_render_target(target.fb, target.tex);
+
+        target = wf_render_target{};
+    }
+}
+
+void render_manager::plan_frame()
+{
+    post_passes.clear();
+
+    if (post_effects.empty())
+    {
+        /* nothing to postprocess, the scene goes directly to the output */
+        scene_target = 0;
+        post_full_damage = false;
+        release_post_targets();
+        return;
+    }
+
+    int w = output->handle->width, h = output->handle->height;
+
+    size_t needed_targets = std::min(post_effects.size(), post_targets.size());
+    bool new_target = false;
+    for (size_t i = 0; i < needed_targets; i++)
+    {
+        auto& target = post_targets[i];
+        if (target.fb != (uint32_t)-1 && target.width == w && target.height == h)
+            continue;
+
+        OpenGL::release_render_target(target.fb, target.tex);
+        OpenGL::allocate_render_target(w, h, target.fb, target.tex,
+                                       WF_GPU_MEMORY_POST_EFFECT);
+        target.width = w;
+        target.height = h;
+        new_target = true;
+    }
+
+    for (size_t i = needed_targets; i < post_targets.size(); i++)
+    {
+        auto& target = post_targets[i];
+        if (target.fb == (uint32_t)-1)
+            continue;
+
+        OpenGL::release_render_target(target.fb, target.tex);
+        target = wf_render_target{};
+    }
+
+    GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+
+    /* the contents of new buffers are undefined, we must fill them */
+    if (new_target)
+    {
+        int sw, sh;
+        wlr_output_transformed_resolution(output->handle, &sw, &sh);
+        pixman_region32_union_rect(&frame_damage, &frame_damage, 0, 0, sw, sh);
+    }
+
+    /* custom renderers repaint everything */
+    post_full_damage = new_target || renderer;
+
+    scene_target = post_targets[0].fb;
+    for (size_t i = 0; i < post_effects.size(); i++)
+    {
+        auto& source = post_targets[i == 0 ? 0 : 1 + (i - 1) % 2];
+        uint32_t target = 0;
+        if (i + 1 < post_effects.size())
+            target = post_targets[1 + i % 2].fb;
+
+        post_passes.push_back({post_effects[i], source.fb, source.tex, target});
+        post_full_damage |= !post_effects[i]->damage_local;
+    }
+}
+
 void render_manager::paint()
 {
     timespec repaint_started;
     clock_gettime(CLOCK_MONOTONIC, &repaint_started);
     cleanup_post_hooks();
 
+    /* plugins which follow the pointer must see where it is now */
+    core->input->flush_pointer_motion();
+
     /* TODO: perhaps we don't need to copy frame damage */
     pixman_region32_clear(&frame_damage);
 
     run_effects(effects[WF_OUTPUT_EFFECT_PRE]);
 
+    flush_view_damage();
+
+    /* the output is still being composited on its thread */
+    if (threaded_frame_running)
+        return;
+
+    if (render_thread_enabled && start_threaded_frame())
+        return;
+
     bool needs_swap;
     if (!output_damage->make_current(&frame_damage, needs_swap))
         return;
@@ -299,6 +726,23 @@ void render_manager::paint()
         return;
     }
 
+    wlr_surface *scanout;
+    auto scanout_result = check_direct_scanout(scanout);
+    ++scanout_stats.frames[scanout_result];
+    set_scanout_surface(scanout, scanout_result);
+    if (scanout)
+    {
+        /* wlroots draws the fullscreen surface when swapping buffers */
+        pixman_region32_t swap_damage;
+        pixman_region32_init_rect(&swap_damage, 0, 0,
+                                  output->handle->width, output->handle->height);
+        output_damage->swap_buffers(&repaint_started, &swap_damage);
+        pixman_region32_fini(&swap_damage);
+
+        post_paint();
+        return;
+    }
+
     pixman_region32_t swap_damage;
     pixman_region32_init(&swap_damage);
 
@@ -321,9 +765,18 @@ void render_manager::paint()
     if (dirty_context)
         load_context();
 
+    plan_frame();
+
+    /* the software renderer doesn't know what was painted over its image */
+    if (software_renderer && (renderer || output_inhibit || post_passes.size() ||
+                              effects[WF_OUTPUT_EFFECT_OVERLAY].size()))
+    {
+        software_renderer->invalidate();
+    }
+
     if (renderer)
     {
-        renderer(default_fb);
+        renderer(scene_target);
         pixman_region32_union_rect(&swap_damage, &swap_damage, 0, 0,
                               output->handle->width, output->handle->height);
         /* TODO: let custom renderers specify what they want to repaint... */
@@ -353,21 +806,30 @@ void render_manager::paint()
 
     run_effects(effects[WF_OUTPUT_EFFECT_OVERLAY]);
     wlr_renderer_scissor(rr, NULL);
-    if (post_effects.size())
+    if (!post_passes.empty())
     {
-        pixman_region32_union_rect(&swap_damage, &swap_damage, 0, 0,
-                                   output->handle->width, output->handle->height);
-
-        GLuint last_fb = default_fb, last_tex = default_tex;
-        for (auto post : post_effects)
+        /* the post hooks are called once per frame, so we limit them to
+         * the extents of the damage. The intermediate buffers keep their
+         * contents between frames, so this is enough for local effects */
+        if (post_full_damage)
         {
-            (*post->hook)(last_fb, last_tex, post->target_fbo);
+            pixman_region32_union_rect(&swap_damage, &swap_damage, 0, 0,
+                                       output->handle->width, output->handle->height);
+        } else
+        {
+            auto extents = wlr_box_from_pixman_box(*pixman_region32_extents(&frame_damage));
+            auto box = get_scissor_box(output, extents);
+            wlr_renderer_scissor(rr, &box);
 
-            last_fb = post->target_fbo;
-            last_tex = post->target_tex;
+            pixman_region32_union_rect(&swap_damage, &swap_damage,
+                                       extents.x, extents.y, extents.width, extents.height);
         }
 
-        assert(last_fb == 0 && last_tex == 0);
+        if (post_full_damage || pixman_region32_not_empty(&frame_damage))
+        {
+            for (auto& pass : post_passes)
+                (*pass.effect->hook)(pass.source_fb, pass.source_tex, pass.target_fb);
+        }
     }
 
     wlr_renderer_scissor(rr, NULL);
@@ -379,6 +841,8 @@ void render_manager::paint()
         GL_CALL(glClear(GL_COLOR_BUFFER_BIT));
     }
 
+    run_captures(&swap_damage);
+
     wlr_renderer_end(rr);
 
     if (renderer)
@@ -386,10 +850,185 @@ void render_manager::paint()
     else
         output_damage->swap_buffers(&repaint_started, &swap_damage);
 
+    timespec repaint_ended;
+    clock_gettime(CLOCK_MONOTONIC, &repaint_ended);
+
+    last_paint_duration = (last_paint_duration + 1) % paint_durations.size();
+    paint_durations[last_paint_duration] =
+        timespec_to_usec(repaint_ended) - timespec_to_usec(repaint_started);
+
     pixman_region32_fini(&swap_damage);
     post_paint();
 }
 
+bool render_manager::start_threaded_frame()
+{
+    /* only plain frames, the rest is painted with GL on this thread */
+    wlr_surface *scanout;
+    if (renderer || output_inhibit || is_viewport_zoomed() ||
+        runtime_config.damage_debug || !post_effects.empty() || !captures.empty() ||
+        !effects[WF_OUTPUT_EFFECT_OVERLAY].empty() || scanout_surface ||
+        check_direct_scanout(scanout) == WF_SCANOUT_OK)
+    {
+        return false;
+    }
+
+    for (auto& icon : core->input->drag_icons)
+    {
+        if (icon->is_mapped())
+            return false;
+    }
+
+    /* workspace changes are handled by the regular path */
+    GetTuple(vx, vy, output->workspace->get_current_workspace());
+    if (dirty_context || current_ws_stream != &output_streams[vx][vy])
+        return false;
+
+    int w, h;
+    wlr_output_transformed_resolution(output->handle, &w, &h);
+
+    pixman_region32_t damage;
+    pixman_region32_init(&damage);
+    if (software_renderer->is_valid() && !runtime_config.no_damage_track)
+        pixman_region32_copy(&damage, &output_damage->frame_damage);
+    else
+        pixman_region32_union_rect(&damage, &damage, 0, 0, w, h);
+
+    pixman_region32_intersect_rect(&damage, &damage, 0, 0, w, h);
+    if (!pixman_region32_not_empty(&damage))
+    {
+        pixman_region32_fini(&damage);
+        return false;
+    }
+
+    struct threaded_surface
+    {
+        wayfire_surface_t *surface;
+        wlr_box box;
+        pixman_region32_t damage;
+    };
+
+    /* top-most first */
+    std::vector<threaded_surface> surfaces;
+    bool can_thread = true;
+
+    auto views = output->workspace->get_views_on_workspace(
+        output->workspace->get_current_workspace(), WF_ALL_LAYERS, false);
+
+    for (auto& view : views)
+    {
+        if (!view->is_visible())
+            continue;
+
+        if (view->has_transformer() || !view->is_mapped() || view->frozen)
+        {
+            can_thread = false;
+            break;
+        }
+
+        view->for_each_surface([&] (wayfire_surface_t *surface, int x, int y)
+        {
+            if (!can_thread || !surface->is_mapped())
+                return;
+
+            threaded_surface ts;
+            ts.surface = surface;
+            ts.box = surface->get_output_geometry();
+            ts.box.x = x;
+            ts.box.y = y;
+            ts.box = get_output_box_from_box(ts.box, output->handle->scale);
+
+            pixman_region32_init_rect(&ts.damage, ts.box.x, ts.box.y,
+                                      ts.box.width, ts.box.height);
+            pixman_region32_intersect(&ts.damage, &ts.damage, &damage);
+
+            if (!pixman_region32_not_empty(&ts.damage))
+            {
+                pixman_region32_fini(&ts.damage);
+                return;
+            }
+
+            if (!wf_software_renderer::can_render(surface))
+            {
+                can_thread = false;
+                pixman_region32_fini(&ts.damage);
+                return;
+            }
+
+            surfaces.push_back(ts);
+        });
+
+        if (!can_thread)
+            break;
+    }
+
+    if (can_thread)
+    {
+        std::vector<wf_software_renderer::item> items;
+        for (auto it = surfaces.rbegin(); it != surfaces.rend(); ++it)
+            items.push_back({it->surface, it->box, &it->damage});
+
+        pixman_region32_copy(&threaded_damage, &damage);
+
+        /* damage from now on is for the next frame */
+        pixman_region32_clear(&output_damage->frame_damage);
+
+        threaded_frame_running = true;
+        software_renderer->start(items, &damage, [=] () { present_threaded_frame(); });
+    }
+
+    for (auto& ts : surfaces)
+        pixman_region32_fini(&ts.damage);
+    pixman_region32_fini(&damage);
+
+    return can_thread;
+}
+
+void render_manager::present_threaded_frame()
+{
+    threaded_frame_running = false;
+
+    timespec repaint_started;
+    clock_gettime(CLOCK_MONOTONIC, &repaint_started);
+
+    /* what was damaged while the frame was composited */
+    pixman_region32_t late, late_shell, damage;
+    pixman_region32_init(&late);
+    pixman_region32_init(&late_shell);
+    pixman_region32_init(&damage);
+    pixman_region32_copy(&late, &output_damage->frame_damage);
+    pixman_region32_copy(&late_shell, &output_damage->shell_damage);
+
+    /* the image of the software renderer is complete, so we can upload
+     * whatever the buffer we get needs */
+    bool needs_swap;
+    if (output_damage->make_current(&damage, needs_swap))
+    {
+        int w, h;
+        wlr_output_transformed_resolution(output->handle, &w, &h);
+
+        pixman_region32_union(&damage, &damage, &threaded_damage);
+        pixman_region32_intersect_rect(&damage, &damage, 0, 0, w, h);
+
+        software_renderer->present(&damage, 0);
+        output_damage->swap_buffers(&repaint_started, &damage);
+    } else
+    {
+        /* nothing was presented, show the composited part next frame */
+        pixman_region32_union(&late, &late, &threaded_damage);
+    }
+
+    if (pixman_region32_not_empty(&late))
+        output_damage->add(&late);
+    pixman_region32_copy(&output_damage->shell_damage, &late_shell);
+
+    pixman_region32_fini(&late);
+    pixman_region32_fini(&late_shell);
+    pixman_region32_fini(&damage);
+
+    post_paint();
+}
+
 void render_manager::post_paint()
 {
     cleanup_post_hooks();
@@ -398,6 +1037,15 @@ void render_manager::post_paint()
     if (constant_redraw)
         schedule_redraw();
 
+    /* with a render delay, frame done was sent before painting */
+    if (frame_done_sent)
+        frame_done_sent = false;
+    else
+        send_frame_done();
+}
+
+void render_manager::send_frame_done()
+{
     auto send_frame_done =
         [=] (wayfire_view v)
         {
@@ -452,22 +1100,61 @@ void render_manager::rem_effect(const effect_hook_t *hook, wf_output_effect_type
     container.erase(it, container.end());
 }
 
-void render_manager::add_post(post_hook_t* hook)
+void render_manager::add_capture(capture_hook_t *hook)
 {
-    auto last_fb = &default_fb, last_tex = &default_tex;
+    captures.push_back(hook);
+    damage(NULL);
+}
+
+void render_manager::rem_capture(capture_hook_t *hook)
+{
+    auto it = std::remove(captures.begin(), captures.end(), hook);
+    captures.erase(it, captures.end());
+}
+
+void render_manager::run_captures(pixman_region32_t *swap_damage)
+{
+    if (captures.empty())
+        return;
+
+    pixman_region32_t damage;
+    pixman_region32_init(&damage);
+
+    int w, h;
+    wlr_output_transformed_resolution(output->handle, &w, &h);
+    pixman_region32_intersect_rect(&damage, swap_damage, 0, 0, w, h);
 
-    if (!post_effects.empty())
+    /* the same boxes we use for scissoring */
+    int n_rect;
+    auto rects = pixman_region32_rectangles(&damage, &n_rect);
+
+    pixman_region32_t fb_damage;
+    pixman_region32_init(&fb_damage);
+    for (int i = 0; i < n_rect; i++)
     {
-        last_fb  = &post_effects.back()->target_fbo;
-        last_tex = &post_effects.back()->target_tex;
+        auto box = get_scissor_box(output, wlr_box_from_pixman_box(rects[i]));
+        pixman_region32_union_rect(&fb_damage, &fb_damage,
+                                   box.x, box.y, box.width, box.height);
     }
 
-    *last_fb = *last_tex = -1;
-    OpenGL::prepare_framebuffer(*last_fb, *last_tex);
+    GL_CALL(glBindFramebuffer(GL_READ_FRAMEBUFFER, 0));
+
+    auto copy = captures;
+    for (auto hook : copy)
+        (*hook)(&fb_damage);
+
+    pixman_region32_fini(&fb_damage);
+    pixman_region32_fini(&damage);
+}
+
+void render_manager::add_post(post_hook_t* hook, bool damage_local)
+{
+    /* the buffers are allocated when planning the next frame */
     damage(NULL);
 
     auto new_hook = new wf_post_effect;
     new_hook->hook = hook;
+    new_hook->damage_local = damage_local;
 
     post_effects.push_back(new_hook);
 }
@@ -479,12 +1166,6 @@ void render_manager::_rem_post(wf_post_effect *post)
     {
         if ((*it) == post)
         {
-            if ((*it)->target_fbo != 0)
-            {
-                GL_CALL(glDeleteFramebuffers(1, &(*it)->target_fbo));
-                GL_CALL(glDeleteTextures(1, &(*it)->target_tex));
-            }
-
             delete *it;
             it = post_effects.erase(it);
         } else
@@ -493,21 +1174,7 @@ void render_manager::_rem_post(wf_post_effect *post)
         }
     }
 
-    auto last_fb = &default_fb, last_tex = &default_tex;
-    if (!post_effects.empty())
-    {
-        last_fb  = &post_effects.back()->target_fbo;
-        last_tex = &post_effects.back()->target_tex;
-    }
-
-    if (last_fb != 0)
-    {
-        GL_CALL(glDeleteFramebuffers(1, last_fb));
-        GL_CALL(glDeleteTextures(1, last_tex));
-
-        *last_fb = *last_tex = 0;
-    }
-
+    /* unused buffers are released when planning the next frame */
     damage(NULL);
 }
 
@@ -542,8 +1209,22 @@ void render_manager::workspace_stream_start(wf_workspace_stream *stream)
 
     OpenGL::bind_context(output->render->ctx);
 
+    /* streams which aren't running may be evicted, they are simply
+     * allocated and painted again the next time they are started */
     if (stream->fbuff == (uint)-1 || stream->tex == (uint)-1)
-        OpenGL::prepare_framebuffer(stream->fbuff, stream->tex);
+    {
+        OpenGL::allocate_render_target(output->handle->width, output->handle->height,
+                                       stream->fbuff, stream->tex,
+                                       WF_GPU_MEMORY_WORKSPACE_STREAM,
+                                       [=] ()
+        {
+            if (stream->running)
+                return false;
+
+            OpenGL::release_render_target(stream->fbuff, stream->tex);
+            return true;
+        });
+    }
 
     GetTuple(vx, vy, stream->ws);
     GetTuple(cx, cy, output->workspace->get_current_workspace());
@@ -574,6 +1255,26 @@ void render_manager::workspace_stream_update(wf_workspace_stream *stream,
     int dx = g.x + (x - cx) * g.width,
         dy = g.y + (y - cy) * g.height;
 
+    /* When zoomed, ws_damage is in screen coordinates and we render only the
+     * surfaces in the visible part of the workspace, directly magnified.
+     * Streams with their own framebuffer are never zoomed */
+    const bool zoomed = stream->fbuff == 0 && is_viewport_zoomed();
+
+    /* workspace-local box to the box it covers in the framebuffer */
+    const auto get_render_box = [&] (wf_geometry box)
+    {
+        if (!zoomed)
+            return get_output_box_from_box(box, output->handle->scale);
+
+        box.x -= viewport_zoom_x;
+        box.y -= viewport_zoom_y;
+        return get_output_box_from_box(box, output->handle->scale * viewport_zoom);
+    };
+
+    /* an evicted stream has no render target until it is started again */
+    if (stream->fbuff != 0 && stream->fbuff != (uint)-1)
+        OpenGL::touch_render_target(stream->fbuff);
+
     pixman_region32_t ws_damage;
     pixman_region32_init(&ws_damage);
     get_ws_damage(stream->ws, &ws_damage);
@@ -622,6 +1323,11 @@ void render_manager::workspace_stream_update(wf_workspace_stream *stream,
         int x, y; // framebuffer coords for the view
         pixman_region32_t damage;
 
+        /* the box of the surface in the framebuffer, for the software
+         * renderer. Snapshotted views are always rendered with GL */
+        wlr_box box;
+        bool snapshot = false;
+
         ~damaged_surface_t()
         { pixman_region32_fini(&damage); }
     };
@@ -638,7 +1344,7 @@ void render_manager::workspace_stream_update(wf_workspace_stream *stream,
             auto bbox = view->get_bounding_box();
 
             bbox = bbox + wf_point{-view_dx, -view_dy};
-            bbox = get_output_box_from_box(bbox, output->handle->scale);
+            bbox = get_render_box(bbox);
 
             pixman_region32_init_rect(&ds->damage,
                                       bbox.x, bbox.y, bbox.width, bbox.height);
@@ -649,6 +1355,7 @@ void render_manager::workspace_stream_update(wf_workspace_stream *stream,
                 ds->x = view_dx;
                 ds->y = view_dy;
                 ds->surface = view.get();
+                ds->snapshot = true;
 
                 to_render.push_back(std::move(ds));
             }
@@ -673,7 +1380,7 @@ void render_manager::workspace_stream_update(wf_workspace_stream *stream,
             obox.x = x;
             obox.y = y;
 
-            obox = get_output_box_from_box(obox, output->handle->scale);
+            obox = get_render_box(obox);
 
             pixman_region32_init_rect(&ds->damage,
                                       obox.x, obox.y,
@@ -685,6 +1392,7 @@ void render_manager::workspace_stream_update(wf_workspace_stream *stream,
                 ds->x = view_dx;
                 ds->y = view_dy;
                 ds->surface = surface;
+                ds->box = obox;
 
                 if (ds->surface->alpha >= 0.999f)
                 {
@@ -736,10 +1444,11 @@ void render_manager::workspace_stream_update(wf_workspace_stream *stream,
         /* We use the snapshot of a view if either condition is happening:
          * 1. The view has a transform
          * 2. The view is visible, but not mapped
-         *    => it is snapshotted and kept alive by some plugin */
+         *    => it is snapshotted and kept alive by some plugin
+         * 3. The view is frozen by a layout transaction */
 
         /* Snapshotted views include all of their subsurfaces, so we handle them separately */
-        if (view->has_transformer() || !view->is_mapped())
+        if (view->has_transformer() || !view->is_mapped() || view->frozen)
         {
             schedule_render_snapshotted_view(view, view_dx, view_dy);
             goto next;
@@ -760,41 +1469,80 @@ void render_manager::workspace_stream_update(wf_workspace_stream *stream,
     std::swap(wayfire_view_transform::global_translate, translate);
     */
 
-    wlr_renderer_begin(core->renderer, output->handle->width, output->handle->height);
+    uint32_t target_buffer = (stream->fbuff == 0 ? scene_target : stream->fbuff);
 
-    int n_rect;
-    auto rects = pixman_region32_rectangles(&ws_damage, &n_rect);
-    GL_CALL(glClearColor(0, 0, 0, 1));
+    /* The software renderer handles only the output itself, and only if
+     * it can render everything that is damaged */
+    bool use_software = software_renderer && stream->fbuff == 0 && !zoomed && !renderer;
+    for (size_t i = 0; use_software && i < to_render.size(); i++)
+    {
+        use_software = !to_render[i]->snapshot &&
+            wf_software_renderer::can_render(to_render[i]->surface);
+    }
 
-    uint32_t target_buffer = (stream->fbuff == 0 ? default_fb : stream->fbuff);
-    GL_CALL(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target_buffer));
-    for (int i = 0; i < n_rect; i++)
+    if (use_software)
     {
-        wlr_box damage = wlr_box_from_pixman_box(rects[i]);
-        auto box = get_scissor_box(output, damage);
+        std::vector<wf_software_renderer::item> items;
+        for (auto rev_it = to_render.rbegin(); rev_it != to_render.rend(); ++rev_it)
+            items.push_back({(*rev_it)->surface, (*rev_it)->box, &(*rev_it)->damage});
 
-        wlr_renderer_scissor(core->renderer, &box);
-        GL_CALL(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
-    }
+        software_renderer->render(items, &ws_damage, target_buffer);
+    } else
+    {
+        if (software_renderer && stream->fbuff == 0)
+            software_renderer->invalidate();
 
-    wlr_renderer_end(core->renderer);
+        wlr_renderer_begin(core->renderer, output->handle->width, output->handle->height);
 
-    wf_framebuffer fb;
-    fb.geometry = output->get_relative_geometry();
-    fb.transform = get_output_matrix_from_transform(output->get_transform());
-    fb.fb = target_buffer;
-    fb.viewport_width = output->handle->width;
-    fb.viewport_height = output->handle->height;
+        int n_rect;
+        auto rects = pixman_region32_rectangles(&ws_damage, &n_rect);
+        GL_CALL(glClearColor(0, 0, 0, 1));
 
-    auto rev_it = to_render.rbegin();
-    while(rev_it != to_render.rend())
-    {
-        auto ds = std::move(*rev_it);
+        GL_CALL(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target_buffer));
+        for (int i = 0; i < n_rect; i++)
+        {
+            wlr_box damage = wlr_box_from_pixman_box(rects[i]);
+            auto box = get_scissor_box(output, damage);
+
+            wlr_renderer_scissor(core->renderer, &box);
+            GL_CALL(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+        }
 
-        fb.geometry.x = ds->x; fb.geometry.y = ds->y;
-        ds->surface->render_fb(&ds->damage, fb);
+        wlr_renderer_end(core->renderer);
 
-        ++rev_it;
+        wf_framebuffer fb;
+        fb.geometry = output->get_relative_geometry();
+        fb.transform = get_output_matrix_from_transform(output->get_transform());
+        fb.fb = target_buffer;
+        fb.viewport_width = output->handle->width;
+        fb.viewport_height = output->handle->height;
+
+        int zoom_dx = 0, zoom_dy = 0;
+        if (zoomed)
+        {
+            /* scale around the top-left corner of the screen, in GL coordinates
+             * that is (-1, 1). The output transform is applied afterwards */
+            const float z = viewport_zoom;
+            auto zoom = glm::translate(glm::mat4(1.0), {z - 1, 1 - z, 0});
+            zoom = glm::scale(zoom, {z, z, 1});
+
+            fb.transform = fb.transform * zoom;
+            fb.zoom = z;
+
+            zoom_dx = viewport_zoom_x;
+            zoom_dy = viewport_zoom_y;
+        }
+
+        auto rev_it = to_render.rbegin();
+        while(rev_it != to_render.rend())
+        {
+            auto ds = std::move(*rev_it);
+
+            fb.geometry.x = ds->x + zoom_dx; fb.geometry.y = ds->y + zoom_dy;
+            ds->surface->render_fb(&ds->damage, fb);
+
+            ++rev_it;
+        }
     }
 
    // std::swap(wayfire_view_transform::global_scale, scale);
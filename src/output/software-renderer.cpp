@@ -0,0 +1,559 @@
+#include "software-renderer.hpp"
+#include "render-manager.hpp"
+#include "output.hpp"
+#include "core.hpp"
+#include "opengl.hpp"
+#include "debug.hpp"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <vector>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <GLES2/gl2ext.h>
+#include <wayland-server.h>
+
+extern "C"
+{
+    /* wlr uses some c99 extensions, we "disable" the static keyword to workaround */
+#define static
+#include <wlr/render/wlr_renderer.h>
+#undef static
+#include <wlr/types/wlr_surface.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/util/region.h>
+}
+
+#include "view/priv-view.hpp"
+
+/* size of the tiles the damage is split in, in pixels */
+static const int TILE_SIZE = 128;
+
+int wf_surface_pixels::frames_in_flight = 0;
+
+wf_surface_pixels::~wf_surface_pixels()
+{
+    if (image)
+        pixman_image_unref(image);
+}
+
+void wf_surface_pixels::update(wlr_surface *surface)
+{
+    /* nothing new, the old buffer might have already been destroyed */
+    if (valid && !pixman_region32_not_empty(&surface->buffer_damage))
+        return;
+
+    valid = false;
+
+    auto buffer = surface->buffer;
+    auto shm = (buffer && buffer->resource) ? wl_shm_buffer_get(buffer->resource) : NULL;
+    if (!shm || surface->current.transform != WL_OUTPUT_TRANSFORM_NORMAL)
+        return;
+
+    pixman_format_code_t format;
+    switch (wl_shm_buffer_get_format(shm))
+    {
+        case WL_SHM_FORMAT_ARGB8888:
+            format = PIXMAN_a8r8g8b8;
+            break;
+        case WL_SHM_FORMAT_XRGB8888:
+            format = PIXMAN_x8r8g8b8;
+            break;
+        default:
+            return;
+    }
+
+    int width = wl_shm_buffer_get_width(shm);
+    int height = wl_shm_buffer_get_height(shm);
+
+    pixman_region32_t region;
+    pixman_region32_init(&region);
+
+    if (!image || pixman_image_get_format(image) != format ||
+        pixman_image_get_width(image) != width ||
+        pixman_image_get_height(image) != height)
+    {
+        if (image)
+            pixman_image_unref(image);
+
+        image = pixman_image_create_bits(format, width, height, NULL, 0);
+        pixman_region32_union_rect(&region, &region, 0, 0, width, height);
+    } else
+    {
+        /* a frame on another thread still reads the old contents */
+        if (shared && frames_in_flight > 0)
+        {
+            auto copy = pixman_image_create_bits(format, width, height, NULL, 0);
+            pixman_image_composite32(PIXMAN_OP_SRC, image, NULL, copy,
+                                     0, 0, 0, 0, 0, 0, width, height);
+            pixman_image_unref(image);
+            image = copy;
+        }
+
+        pixman_region32_intersect_rect(&region, &surface->buffer_damage,
+                                       0, 0, width, height);
+    }
+
+    shared = false;
+
+    wl_shm_buffer_begin_access(shm);
+    auto src = pixman_image_create_bits_no_clear(format, width, height,
+        (uint32_t*) wl_shm_buffer_get_data(shm), wl_shm_buffer_get_stride(shm));
+
+    pixman_image_set_clip_region32(image, &region);
+    pixman_image_composite32(PIXMAN_OP_SRC, src, NULL, image,
+                             0, 0, 0, 0, 0, 0, width, height);
+    pixman_image_set_clip_region32(image, NULL);
+
+    pixman_image_unref(src);
+    wl_shm_buffer_end_access(shm);
+    pixman_region32_fini(&region);
+
+    scale = surface->current.scale;
+    valid = true;
+}
+
+wf_software_renderer::wf_software_renderer(wayfire_output *output)
+{
+    this->output = output;
+    pixman_region32_init(&thread_damage);
+}
+
+wf_software_renderer::~wf_software_renderer()
+{
+    if (thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(thread_mutex);
+            thread_quit = true;
+            thread_wakeup.notify_one();
+        }
+
+        thread.join();
+    }
+
+    /* a frame was started, but we never got to present it */
+    if (thread_done)
+        release_thread_frame();
+
+    if (done_source)
+        wl_event_source_remove(done_source);
+    if (done_fd >= 0)
+        close(done_fd);
+
+    pixman_region32_fini(&thread_damage);
+
+    if (target)
+        pixman_image_unref(target);
+
+    if (tex != (uint32_t)-1)
+    {
+        OpenGL::bind_context(output->render->ctx);
+        GL_CALL(glDeleteTextures(1, &tex));
+    }
+}
+
+bool wf_software_renderer::can_render(wayfire_surface_t *surface)
+{
+    return surface->pixels && surface->pixels->valid;
+}
+
+void wf_software_renderer::resize(int width, int height)
+{
+    if (target)
+        pixman_image_unref(target);
+
+    target = pixman_image_create_bits(PIXMAN_a8r8g8b8, width, height, NULL, 0);
+
+    if (tex != (uint32_t)-1)
+    {
+        OpenGL::bind_context(output->render->ctx);
+        GL_CALL(glDeleteTextures(1, &tex));
+        tex = -1;
+    }
+
+    this->width = width;
+    this->height = height;
+    target_valid = false;
+}
+
+void wf_software_renderer::prepare_target()
+{
+    int w, h;
+    wlr_output_transformed_resolution(output->handle, &w, &h);
+    if (!target || w != width || h != height)
+        resize(w, h);
+}
+
+void wf_software_renderer::render(const std::vector<item>& items,
+                                  pixman_region32_t *damage, uint32_t target_fb)
+{
+    prepare_target();
+
+    std::vector<frame_item> frame_items(items.size());
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        auto& fi = frame_items[i];
+        fi.image = items[i].surface->pixels->image;
+        fi.box = items[i].box;
+        fi.alpha = items[i].surface->alpha;
+
+        pixman_region32_init(&fi.damage);
+        pixman_region32_copy(&fi.damage, items[i].damage);
+    }
+
+    composite(frame_items, damage);
+
+    for (auto& fi : frame_items)
+        pixman_region32_fini(&fi.damage);
+
+    present(damage, target_fb);
+}
+
+int handle_thread_frame_done(int fd, uint32_t, void *data)
+{
+    auto renderer = static_cast<wf_software_renderer*> (data);
+
+    uint64_t count;
+    if (read(fd, &count, sizeof(count)) != sizeof(count))
+        return 0;
+
+    renderer->release_thread_frame();
+
+    auto done = std::move(renderer->thread_done);
+    renderer->thread_done = nullptr;
+
+    if (done)
+        done();
+
+    return 0;
+}
+
+void wf_software_renderer::start(const std::vector<item>& items,
+                                 pixman_region32_t *damage,
+                                 std::function<void()> done)
+{
+    prepare_target();
+
+    if (!thread.joinable())
+    {
+        done_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        done_source = wl_event_loop_add_fd(core->ev_loop, done_fd, WL_EVENT_READABLE,
+                                           handle_thread_frame_done, this);
+        thread = std::thread([=] () { thread_main(); });
+    }
+
+    /* the images are referenced and never changed while the frame is
+     * running, see wf_surface_pixels::update() */
+    thread_items.resize(items.size());
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        auto& fi = thread_items[i];
+        auto pixels = items[i].surface->pixels.get();
+
+        fi.image = pixman_image_ref(pixels->image);
+        fi.box = items[i].box;
+        fi.alpha = items[i].surface->alpha;
+
+        pixman_region32_init(&fi.damage);
+        pixman_region32_copy(&fi.damage, items[i].damage);
+
+        pixels->shared = true;
+    }
+
+    pixman_region32_copy(&thread_damage, damage);
+    thread_done = done;
+    target_valid = true;
+
+    ++wf_surface_pixels::frames_in_flight;
+
+    std::lock_guard<std::mutex> lock(thread_mutex);
+    thread_has_frame = true;
+    thread_wakeup.notify_one();
+}
+
+void wf_software_renderer::thread_main()
+{
+    std::unique_lock<std::mutex> lock(thread_mutex);
+    while (true)
+    {
+        thread_wakeup.wait(lock, [=] () { return thread_quit || thread_has_frame; });
+        if (thread_quit)
+            return;
+
+        lock.unlock();
+        composite(thread_items, &thread_damage);
+        lock.lock();
+
+        thread_has_frame = false;
+
+        uint64_t one = 1;
+        if (write(done_fd, &one, sizeof(one)) != sizeof(one))
+            log_error("failed to signal the end of a threaded frame");
+    }
+}
+
+void wf_software_renderer::release_thread_frame()
+{
+    for (auto& fi : thread_items)
+    {
+        pixman_image_unref(fi.image);
+        pixman_region32_fini(&fi.damage);
+    }
+
+    thread_items.clear();
+    --wf_surface_pixels::frames_in_flight;
+}
+
+void wf_software_renderer::composite(const std::vector<frame_item>& items,
+                                     pixman_region32_t *damage)
+{
+    std::vector<wlr_box> tiles;
+    auto extents = pixman_region32_extents(damage);
+
+    int start_x = std::max(extents->x1, 0) / TILE_SIZE * TILE_SIZE;
+    int start_y = std::max(extents->y1, 0) / TILE_SIZE * TILE_SIZE;
+
+    for (int y = start_y; y < extents->y2; y += TILE_SIZE)
+    {
+        for (int x = start_x; x < extents->x2; x += TILE_SIZE)
+        {
+            pixman_box32_t tile = {x, y, x + TILE_SIZE, y + TILE_SIZE};
+            if (pixman_region32_contains_rectangle(damage, &tile) != PIXMAN_REGION_OUT)
+                tiles.push_back({x, y, TILE_SIZE, TILE_SIZE});
+        }
+    }
+
+    render_workers::run(tiles.size(), [&] (int i)
+    {
+        render_tile(items, damage, tiles[i]);
+    });
+}
+
+void wf_software_renderer::render_tile(const std::vector<frame_item>& items,
+                                       pixman_region32_t *damage, const wlr_box& tile)
+{
+    pixman_region32_t tile_damage;
+    pixman_region32_init_rect(&tile_damage, tile.x, tile.y, tile.width, tile.height);
+    pixman_region32_intersect(&tile_damage, &tile_damage, damage);
+    pixman_region32_intersect_rect(&tile_damage, &tile_damage, 0, 0, width, height);
+
+    /* pixman validates images lazily when compositing, so the tiles can't
+     * share image structs. They share only the pixels */
+    auto dst = pixman_image_create_bits_no_clear(PIXMAN_a8r8g8b8, width, height,
+        pixman_image_get_data(target), pixman_image_get_stride(target));
+
+    int n_rect;
+    auto rects = pixman_region32_rectangles(&tile_damage, &n_rect);
+
+    pixman_color_t black = {0, 0, 0, 0xffff};
+    pixman_image_fill_boxes(PIXMAN_OP_SRC, dst, &black, n_rect, rects);
+
+    pixman_region32_t region;
+    pixman_region32_init(&region);
+
+    for (auto& item : items)
+    {
+        pixman_region32_intersect(&region, &item.damage, &tile_damage);
+        if (!pixman_region32_not_empty(&region))
+            continue;
+
+        auto pixels = item.image;
+        int pw = pixman_image_get_width(pixels), ph = pixman_image_get_height(pixels);
+
+        auto src = pixman_image_create_bits_no_clear(pixman_image_get_format(pixels),
+            pw, ph, pixman_image_get_data(pixels), pixman_image_get_stride(pixels));
+
+        /* the transform maps output pixels to buffer pixels */
+        if (pw != item.box.width || ph != item.box.height)
+        {
+            pixman_transform_t scale;
+            pixman_transform_init_scale(&scale,
+                pixman_double_to_fixed(1.0 * pw / item.box.width),
+                pixman_double_to_fixed(1.0 * ph / item.box.height));
+
+            pixman_image_set_transform(src, &scale);
+            pixman_image_set_filter(src, PIXMAN_FILTER_BILINEAR, NULL, 0);
+        }
+
+        pixman_image_t *mask = NULL;
+        if (item.alpha < 0.999f)
+        {
+            pixman_color_t alpha = {0, 0, 0, (uint16_t)(item.alpha * 0xffff)};
+            mask = pixman_image_create_solid_fill(&alpha);
+        }
+
+        auto boxes = pixman_region32_rectangles(&region, &n_rect);
+        for (int i = 0; i < n_rect; i++)
+        {
+            auto& b = boxes[i];
+            pixman_image_composite32(PIXMAN_OP_OVER, src, mask, dst,
+                                     b.x1 - item.box.x, b.y1 - item.box.y,
+                                     0, 0, b.x1, b.y1, b.x2 - b.x1, b.y2 - b.y1);
+        }
+
+        if (mask)
+            pixman_image_unref(mask);
+        pixman_image_unref(src);
+    }
+
+    pixman_region32_fini(&region);
+    pixman_region32_fini(&tile_damage);
+    pixman_image_unref(dst);
+}
+
+void wf_software_renderer::present(pixman_region32_t *damage, uint32_t target_fb)
+{
+    OpenGL::bind_context(output->render->ctx);
+
+    if (tex == (uint32_t)-1)
+    {
+        GL_CALL(glGenTextures(1, &tex));
+        GL_CALL(glBindTexture(GL_TEXTURE_2D, tex));
+        GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_BGRA_EXT, width, height,
+                             0, GL_BGRA_EXT, GL_UNSIGNED_BYTE, NULL));
+    }
+
+    int n_rect;
+    auto rects = pixman_region32_rectangles(damage, &n_rect);
+
+    GL_CALL(glBindTexture(GL_TEXTURE_2D, tex));
+    GL_CALL(glPixelStorei(GL_UNPACK_ROW_LENGTH, pixman_image_get_stride(target) / 4));
+    for (int i = 0; i < n_rect; i++)
+    {
+        int x1 = std::max(rects[i].x1, 0), y1 = std::max(rects[i].y1, 0);
+        int x2 = std::min(rects[i].x2, width), y2 = std::min(rects[i].y2, height);
+        if (x1 >= x2 || y1 >= y2)
+            continue;
+
+        GL_CALL(glPixelStorei(GL_UNPACK_SKIP_PIXELS, x1));
+        GL_CALL(glPixelStorei(GL_UNPACK_SKIP_ROWS, y1));
+        GL_CALL(glTexSubImage2D(GL_TEXTURE_2D, 0, x1, y1, x2 - x1, y2 - y1,
+                                GL_BGRA_EXT, GL_UNSIGNED_BYTE,
+                                pixman_image_get_data(target)));
+    }
+
+    GL_CALL(glPixelStorei(GL_UNPACK_ROW_LENGTH, 0));
+    GL_CALL(glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0));
+    GL_CALL(glPixelStorei(GL_UNPACK_SKIP_ROWS, 0));
+
+    wlr_renderer_begin(core->renderer, output->handle->width, output->handle->height);
+    GL_CALL(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target_fb));
+
+    /* the image is in output-local coordinates, top row first */
+    auto transform = get_output_matrix_from_transform(output->get_transform());
+    for (int i = 0; i < n_rect; i++)
+    {
+        auto box = get_scissor_box(output, wlr_box_from_pixman_box(rects[i]));
+        wlr_renderer_scissor(core->renderer, &box);
+        OpenGL::render_transformed_texture(tex, {-1, -1, 1, 1}, {}, transform);
+    }
+
+    wlr_renderer_end(core->renderer);
+    GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+}
+
+namespace render_workers
+{
+    namespace
+    {
+        struct batch_t
+        {
+            const std::function<void(int)> *job;
+            int count, next = 0, running = 0;
+
+            bool has_work() const { return next < count; }
+            bool done() const { return next >= count && running == 0; }
+        };
+
+        std::mutex mutex;
+        std::condition_variable work_available, work_done;
+
+        /* batches of all threads which are rendering right now */
+        std::vector<batch_t*> batches;
+
+        bool started = false;
+    }
+
+    /* the batch with work which the least workers help with, so that the
+     * outputs share the workers. Must be called with the lock held */
+    static batch_t *find_batch()
+    {
+        batch_t *best = nullptr;
+        for (auto batch : batches)
+        {
+            if (batch->has_work() && (!best || batch->running < best->running))
+                best = batch;
+        }
+
+        return best;
+    }
+
+    /* run the next job of the batch, if there is one.
+     * Must be called with the lock held */
+    static bool run_next_job(batch_t *batch, std::unique_lock<std::mutex>& lock)
+    {
+        if (!batch || !batch->has_work())
+            return false;
+
+        int index = batch->next++;
+        ++batch->running;
+
+        lock.unlock();
+        (*batch->job)(index);
+        lock.lock();
+
+        if (--batch->running == 0 && !batch->has_work())
+            work_done.notify_all();
+
+        return true;
+    }
+
+    static void worker_main()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            work_available.wait(lock, [] { return find_batch() != nullptr; });
+            run_next_job(find_batch(), lock);
+        }
+    }
+
+    static void start_workers()
+    {
+        /* the calling thread renders as well */
+        int count = std::max((int)std::thread::hardware_concurrency() - 1, 0);
+        log_info("starting %d render workers", count);
+
+        /* the workers live as long as the compositor */
+        for (int i = 0; i < count; i++)
+            std::thread(worker_main).detach();
+
+        started = true;
+    }
+
+    void run(int count, const std::function<void(int)>& job)
+    {
+        batch_t batch;
+        batch.job = &job;
+        batch.count = count;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!started)
+            start_workers();
+
+        batches.push_back(&batch);
+        work_available.notify_all();
+
+        /* the calling thread works only on its own batch, so that it
+         * doesn't wait for the tiles of another output */
+        while (run_next_job(&batch, lock));
+
+        work_done.wait(lock, [&] { return batch.done(); });
+        batches.erase(std::find(batches.begin(), batches.end(), &batch));
+    }
+}
@@ -0,0 +1,139 @@
+#ifndef SOFTWARE_RENDERER_HPP
+#define SOFTWARE_RENDERER_HPP
+
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <pixman.h>
+
+extern "C"
+{
+#include <wlr/types/wlr_box.h>
+}
+
+class wayfire_output;
+class wayfire_surface_t;
+struct wlr_surface;
+struct wl_event_source;
+
+/* The contents of a shm surface in system memory, so that it can be
+ * composited on the CPU. wlroots releases shm buffers as soon as it has
+ * uploaded them to a texture, so we copy the damaged part on each commit,
+ * before the client gets the release event */
+struct wf_surface_pixels
+{
+    pixman_image_t *image = nullptr;
+    int32_t scale = 1;
+
+    /* the image has the full contents of the surface */
+    bool valid = false;
+
+    /* the image is used by a frame which is composited on another thread,
+     * so it is copied before it is changed */
+    bool shared = false;
+    /* frames being composited on other threads, main thread only */
+    static int frames_in_flight;
+
+    void update(wlr_surface *surface);
+    ~wf_surface_pixels();
+};
+
+/* Composites the surfaces of the current workspace with pixman instead of
+ * GLES, which is much faster on outputs without a real GPU (for ex. headless
+ * outputs using llvmpipe). The damage is split in tiles, which are rendered
+ * in parallel, and the result is uploaded to the output with a single
+ * texture upload per damaged rectangle.
+ *
+ * Only plain shm surfaces can be rendered this way. If a frame contains
+ * anything else (transformed views, snapshots, GL buffers, decorations
+ * drawn with GL), it is rendered with GLES as usual */
+class wf_software_renderer
+{
+    public:
+        struct item
+        {
+            wayfire_surface_t *surface;
+            /* where the surface is, in output framebuffer coordinates */
+            wlr_box box;
+            /* the part of the output we must repaint */
+            pixman_region32_t *damage;
+        };
+
+        wf_software_renderer(wayfire_output *output);
+        ~wf_software_renderer();
+
+        static bool can_render(wayfire_surface_t *surface);
+
+        /* render the items, bottom-most first, to the given framebuffer */
+        void render(const std::vector<item>& items, pixman_region32_t *damage,
+                    uint32_t target_fb);
+
+        /* Threaded composition: start() takes a snapshot of the items and
+         * composites it on the thread of this output, then calls done on
+         * the main thread. Until then, the renderer can't be used */
+        void start(const std::vector<item>& items, pixman_region32_t *damage,
+                   std::function<void()> done);
+
+        /* upload the given part of the composited output to the framebuffer */
+        void present(pixman_region32_t *damage, uint32_t target_fb);
+
+        /* the output was painted without us, so the next frame must be
+         * composited in full */
+        void invalidate() { target_valid = false; }
+        bool is_valid() { return target_valid; }
+
+    private:
+        wayfire_output *output;
+
+        pixman_image_t *target = nullptr;
+        bool target_valid = false;
+        uint32_t tex = -1;
+        int width = 0, height = 0;
+
+        /* what the composition needs of an item. For threaded frames, this
+         * is all the thread sees of the scene */
+        struct frame_item
+        {
+            pixman_image_t *image;
+            wlr_box box;
+            float alpha;
+            pixman_region32_t damage;
+        };
+
+        void resize(int width, int height);
+        void prepare_target();
+        void composite(const std::vector<frame_item>& items, pixman_region32_t *damage);
+        void render_tile(const std::vector<frame_item>& items, pixman_region32_t *damage,
+                         const wlr_box& tile);
+
+        /* the frame of the thread, owned by the main thread when no frame
+         * is running */
+        std::vector<frame_item> thread_items;
+        pixman_region32_t thread_damage;
+        std::function<void()> thread_done;
+
+        std::thread thread;
+        std::mutex thread_mutex;
+        std::condition_variable thread_wakeup;
+        bool thread_has_frame = false, thread_quit = false;
+
+        int done_fd = -1;
+        wl_event_source *done_source = nullptr;
+
+        void thread_main();
+        void release_thread_frame();
+        friend int handle_thread_frame_done(int, uint32_t, void*);
+};
+
+/* A pool of worker threads, shared by all outputs */
+namespace render_workers
+{
+    /* run job(0), ..., job(count - 1) on the workers and the calling thread,
+     * returns when all of them are done. Batches from different threads
+     * run at the same time and share the workers */
+    void run(int count, const std::function<void(int)>& job);
+}
+
+#endif /* end of include guard: SOFTWARE_RENDERER_HPP */
@@ -1,5 +1,4 @@
 #include <algorithm>
-#include "nonstd/make_unique.hpp"
 #include "output.hpp"
 #include "core.hpp"
 #include "debug.hpp"
@@ -37,35 +36,22 @@ static void zwf_wm_surface_configure(struct wl_client *client,
 struct wf_shell_reserved_custom_data : public wf_custom_view_data
 {
     workspace_manager::anchored_area area;
-    static const std::string cname;
-};
 
-const std::string wf_shell_reserved_custom_data::cname = "wf-shell-reserved-area";
+    wf_shell_reserved_custom_data()
+    {
+        area.reserved_size = -1;
+        area.real_size = 0;
+    }
+};
 
 bool view_has_anchored_area(wayfire_view view)
 {
-    return view->custom_data.count(wf_shell_reserved_custom_data::cname);
+    return view->get_data<wf_shell_reserved_custom_data>();
 }
 
 static workspace_manager::anchored_area *get_anchored_area_for_view(wayfire_view view)
 {
-    wf_shell_reserved_custom_data *cdata = NULL;
-    const auto cname = wf_shell_reserved_custom_data::cname;
-
-    if (view->custom_data.count(cname))
-    {
-        cdata = dynamic_cast<wf_shell_reserved_custom_data*> (view->custom_data[cname].get());
-    } else
-    {
-        auto data = nonstd::make_unique<wf_shell_reserved_custom_data>();
-        data->area.reserved_size = -1;
-        data->area.real_size = 0;
-
-        cdata = data.get();
-        view->custom_data[cname] = std::move(data);
-    }
-
-    return &cdata->area;
+    return &view->get_data_safe<wf_shell_reserved_custom_data>()->area;
 }
 
 static void zwf_wm_surface_set_exclusive_zone(struct wl_client *client,
@@ -37,10 +37,25 @@ class wayfire_layer_shell_view : public wayfire_view_t
 {
     bool first_map = true;
     wl_listener map_ev, unmap_ev, destroy_ev, new_popup;
+
+    /* the last box we sent, so that we don't configure the client
+     * again when the layers are rearranged but the view stays the same */
+    wf_geometry last_configure = {0, 0, -1, -1};
+
     public:
         wlr_layer_surface *lsurface;
         wlr_layer_surface_state prev_state;
 
+        /* what has to be rearranged because of this view on the next idle */
+        enum
+        {
+            ARRANGE_NONE   = 0,
+            /* only the size or margins of the view have changed */
+            ARRANGE_VIEW   = 1,
+            /* everything on the output of the view */
+            ARRANGE_OUTPUT = 2
+        } pending_arrange = ARRANGE_NONE;
+
         std::unique_ptr<workspace_manager::anchored_area> anchored_area;
 
         wayfire_layer_shell_view(wlr_layer_surface *lsurf);
@@ -116,6 +131,94 @@ struct wf_layer_shell_manager
         return result;
     }
 
+    wl_event_source *idle_arrange = nullptr;
+
+    /* Clients which animate their size (for ex. autohiding docks) change
+     * their state at each frame, so instead of arranging everything on
+     * each commit, we arrange only what changed, once per loop iteration */
+    void schedule_arrange(wayfire_layer_shell_view *view, bool whole_output)
+    {
+        if (whole_output)
+            view->pending_arrange = wayfire_layer_shell_view::ARRANGE_OUTPUT;
+        else if (view->pending_arrange == wayfire_layer_shell_view::ARRANGE_NONE)
+            view->pending_arrange = wayfire_layer_shell_view::ARRANGE_VIEW;
+
+        if (!idle_arrange)
+            idle_arrange = wl_event_loop_add_idle(core->ev_loop, idle_arrange_cb, this);
+    }
+
+    static void idle_arrange_cb(void *data)
+    {
+        ((wf_layer_shell_manager*) data)->arrange_pending();
+    }
+
+    void arrange_pending()
+    {
+        idle_arrange = nullptr;
+
+        for (int i = 0; i < 4; i++)
+        {
+            /* arrange_layers() clears the pending state of all views on
+             * the output, so each output is arranged at most once */
+            for (size_t j = 0; j < layers[i].size(); j++)
+            {
+                auto v = layers[i][j];
+                if (v->pending_arrange == wayfire_layer_shell_view::ARRANGE_OUTPUT)
+                    arrange_layers(v->get_output());
+            }
+        }
+
+        for (int i = 0; i < 4; i++)
+        {
+            for (size_t j = 0; j < layers[i].size(); j++)
+            {
+                auto v = layers[i][j];
+                if (v->pending_arrange == wayfire_layer_shell_view::ARRANGE_VIEW)
+                    arrange_view(v);
+            }
+        }
+    }
+
+    /* the view kept its anchors and exclusive zone, only its size changed */
+    void arrange_view(wayfire_layer_shell_view *v)
+    {
+        v->pending_arrange = wayfire_layer_shell_view::ARRANGE_NONE;
+
+        auto output = v->get_output();
+        if (!v->anchored_area)
+        {
+            pin_view(v, output->workspace->get_workarea());
+            return;
+        }
+
+        update_anchored_area(v);
+
+        /* the workspace manager configures the panels again, but only those
+         * which actually move are sent a configure */
+        auto old_workarea = output->workspace->get_workarea();
+        output->workspace->reflow_reserved_areas();
+
+        auto usable_workarea = output->workspace->get_workarea();
+        if (usable_workarea == old_workarea)
+            return;
+
+        for (int i = 0; i < 4; i++)
+        {
+            for (auto view : layers[i])
+            {
+                if (view->get_output() == output && !view->anchored_area)
+                    pin_view(view, usable_workarea);
+            }
+        }
+    }
+
+    void update_anchored_area(wayfire_layer_shell_view *v)
+    {
+        v->anchored_area->reserved_size = v->lsurface->current.exclusive_zone;
+        v->anchored_area->real_size = v->anchored_area->edge <= workspace_manager::WORKSPACE_ANCHORED_EDGE_BOTTOM ?
+            v->lsurface->current.desired_height : v->lsurface->current.desired_width;
+    }
+
     void set_exclusive_zone(wayfire_layer_shell_view *v)
     {
         int edges = v->lsurface->current.anchor;
@@ -132,9 +235,7 @@ struct wf_layer_shell_manager
         { v->configure(geometry); };
 
         v->anchored_area->edge = anchor_to_edge(edges);
-        v->anchored_area->reserved_size = v->lsurface->current.exclusive_zone;
-        v->anchored_area->real_size = v->anchored_area->edge <= workspace_manager::WORKSPACE_ANCHORED_EDGE_BOTTOM ?
-            v->lsurface->current.desired_height : v->lsurface->current.desired_width;
+        update_anchored_area(v);
 
         v->get_output()->workspace->add_reserved_area(v->anchored_area.get());
     }
@@ -226,6 +327,7 @@ struct wf_layer_shell_manager
                 output->workspace->remove_reserved_area(v->anchored_area.get());
 
             v->anchored_area = nullptr;
+            v->pending_arrange = wayfire_layer_shell_view::ARRANGE_NONE;
         }
 
         uint32_t focus1 = arrange_layer(output, ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY);
@@ -270,6 +372,7 @@ wayfire_layer_shell_view::wayfire_layer_shell_view(wlr_layer_surface *lsurf)
     }
 
     lsurf->output = output->handle;
+    std::memset(&prev_state, 0, sizeof(prev_state));
 
     role = WF_VIEW_ROLE_SHELL_VIEW;
     lsurface->data = this;
@@ -332,7 +435,13 @@ void wayfire_layer_shell_view::commit()
 
     if (std::memcmp(state, &prev_state, sizeof(*state)))
     {
-        layer_shell_manager.arrange_layers(output);
+        /* anything but a change of the size and the margins can move the
+         * other layer surfaces as well */
+        bool whole_output = state->anchor != prev_state.anchor ||
+            state->keyboard_interactive != prev_state.keyboard_interactive ||
+            (state->exclusive_zone > 0) != (prev_state.exclusive_zone > 0);
+
+        layer_shell_manager.schedule_arrange(this, whole_output);
         std::memcpy(&prev_state, state, sizeof(*state));
     }
 }
@@ -386,6 +495,10 @@ void wayfire_layer_shell_view::configure(wf_geometry box)
         close();
     }
 
+    if (box == last_configure)
+        return;
+    last_configure = box;
+
     wayfire_view_t::move(box.x, box.y, false);
     wayfire_view_t::resize(box.width, box.height, false);
 
@@ -0,0 +1,207 @@
+#include "layout-transaction.hpp"
+#include "core.hpp"
+#include "debug.hpp"
+#include "output.hpp"
+#include <config.hpp>
+
+#include <vector>
+#include <algorithm>
+
+#include <wayland-server.h>
+
+namespace
+{
+    struct transaction_view_t
+    {
+        wayfire_view view;
+        wf_geometry target;
+
+        /* the size of the view before the transaction */
+        int initial_width, initial_height;
+        /* the client has committed a buffer for its new size */
+        bool ready;
+    };
+
+    using transaction_views = std::vector<transaction_view_t>;
+
+    /* the views of the transactions which are still open */
+    int open_transactions = 0;
+    transaction_views building;
+
+    /* the views which wait for their clients. Transactions committed while
+     * another one is waiting are merged with it, so that a view never
+     * belongs to two transactions */
+    transaction_views in_flight;
+    wl_event_source *timeout = nullptr;
+
+    transaction_views::iterator find_view(transaction_views& views, wayfire_view_t *view)
+    {
+        return std::find_if(views.begin(), views.end(),
+                            [=] (const transaction_view_t& tv)
+                            { return tv.view.get() == view; });
+    }
+}
+
+static void apply_in_flight()
+{
+    auto views = std::move(in_flight);
+    in_flight.clear();
+
+    if (timeout)
+        wl_event_source_timer_update(timeout, 0);
+
+    for (auto& tv : views)
+        tv.view->thaw();
+}
+
+static void check_in_flight()
+{
+    for (auto& tv : in_flight)
+    {
+        if (!tv.ready)
+            return;
+    }
+
+    apply_in_flight();
+}
+
+static int handle_transaction_timeout(void*)
+{
+    log_info("layout transaction timed out, applying it anyway");
+    apply_in_flight();
+    return 0;
+}
+
+static void update_ready(transaction_view_t& tv)
+{
+    auto wm = tv.view->get_wm_geometry();
+
+    /* clients may pick a size close to the one we asked for, for ex.
+     * terminals round it to whole cells. Any new size is an answer */
+    tv.ready = (wm.width == tv.target.width && wm.height == tv.target.height) ||
+        wm.width != tv.initial_width || wm.height != tv.initial_height;
+}
+
+static void commit_transaction(transaction_views views)
+{
+    bool needs_wait = false;
+    for (auto& tv : views)
+    {
+        auto wm = tv.view->get_wm_geometry();
+        tv.initial_width = wm.width;
+        tv.initial_height = wm.height;
+
+        needs_wait |= (wm.width != tv.target.width || wm.height != tv.target.height);
+    }
+
+    /* just moving views needs no waiting */
+    if (!needs_wait && in_flight.empty())
+    {
+        for (auto& tv : views)
+            tv.view->set_geometry(tv.target);
+
+        return;
+    }
+
+    /* merged transactions keep the timeout of the first one, so that
+     * frequent relayouts can't keep the views frozen */
+    bool start_timeout = in_flight.empty();
+
+    /* freeze the views before changing their geometry, so that they are
+     * shown as they were until the transaction is applied */
+    for (auto& tv : views)
+    {
+        if (!tv.view->freeze())
+            continue;
+
+        auto it = find_view(in_flight, tv.view.get());
+        if (it != in_flight.end())
+        {
+            /* the client hasn't answered the old transaction yet, so it
+             * is still showing the initial size from there */
+            if (!it->ready)
+            {
+                tv.initial_width = it->initial_width;
+                tv.initial_height = it->initial_height;
+            }
+
+            *it = tv;
+        } else
+        {
+            in_flight.push_back(tv);
+        }
+    }
+
+    for (auto& tv : views)
+        tv.view->set_geometry(tv.target);
+
+    for (auto& tv : in_flight)
+    {
+        if (find_view(views, tv.view.get()) != views.end())
+            update_ready(tv);
+    }
+
+    if (!timeout)
+        timeout = wl_event_loop_add_timer(core->ev_loop, handle_transaction_timeout, NULL);
+
+    if (start_timeout)
+    {
+        auto section = core->config->get_section("core");
+        int timeout_ms = section->get_option("transaction_timeout", "100")->as_int();
+        wl_event_source_timer_update(timeout, std::max(timeout_ms, 1));
+    }
+
+    check_in_flight();
+}
+
+wf_layout_transaction::wf_layout_transaction()
+{
+    ++open_transactions;
+}
+
+wf_layout_transaction::~wf_layout_transaction()
+{
+    if (--open_transactions > 0)
+        return;
+
+    auto views = std::move(building);
+    building.clear();
+
+    if (views.size())
+        commit_transaction(std::move(views));
+}
+
+void wf_layout_transaction::set_geometry(wayfire_view view, wf_geometry geometry)
+{
+    auto it = find_view(building, view.get());
+    if (it != building.end())
+    {
+        it->target = geometry;
+        return;
+    }
+
+    transaction_view_t tv;
+    tv.view = view;
+    tv.target = geometry;
+    building.push_back(tv);
+}
+
+void wf_layout_transaction_view_committed(wayfire_view_t *view)
+{
+    auto it = find_view(in_flight, view);
+    if (it == in_flight.end() || it->ready)
+        return;
+
+    update_ready(*it);
+    check_in_flight();
+}
+
+void wf_layout_transaction_view_unmapped(wayfire_view_t *view)
+{
+    auto it = find_view(in_flight, view);
+    if (it != in_flight.end())
+        in_flight.erase(it);
+
+    view->thaw();
+    check_in_flight();
+}
@@ -16,6 +16,7 @@ extern "C"
 #include "debug.hpp"
 #include "render-manager.hpp"
 #include "signal-definitions.hpp"
+#include "../output/software-renderer.hpp"
 
 void handle_surface_committed(wl_listener*, void *data)
 {
@@ -94,6 +95,8 @@ wayfire_surface_t::~wayfire_surface_t()
             else
                 ++it;
         }
+
+        parent_surface->surface_tree_changed();
     }
 
     for (auto c : surface_children)
@@ -205,6 +208,7 @@ void wayfire_surface_t::map(wlr_surface *surface)
     }
 
     surface->data = this;
+    surface_tree_changed();
     damage();
 
     wlr_subsurface *sub;
@@ -224,6 +228,8 @@ void wayfire_surface_t::unmap()
     damage();
 
     this->surface = nullptr;
+    pixels.reset();
+    surface_tree_changed();
     emit_map_state_change(this);
 
     wl_list_remove(&new_sub.link);
@@ -254,6 +260,10 @@ void wayfire_surface_t::dec_keep_count()
 
 void wayfire_surface_t::damage(pixman_region32_t *region)
 {
+    /* the view takes the whole region at once */
+    if (parent_surface)
+        return parent_surface->damage(region);
+
     int n_rect;
     auto rects = pixman_region32_rectangles(region, &n_rect);
 
@@ -267,6 +277,12 @@ void wayfire_surface_t::damage(const wlr_box& box)
         parent_surface->damage(box);
 }
 
+void wayfire_surface_t::surface_tree_changed()
+{
+    if (parent_surface)
+        parent_surface->surface_tree_changed();
+}
+
 void wayfire_surface_t::damage()
 {
     /* TODO: bounding box damage */
@@ -312,9 +328,29 @@ void wayfire_surface_t::apply_surface_damage(int x, int y)
 void wayfire_surface_t::commit()
 {
     update_output_position();
+
+    /* content damage doesn't change the bounding box, only a new size or
+     * position of the surface does */
+    auto box = get_output_geometry();
+    if (box != committed_box)
+    {
+        committed_box = box;
+        surface_tree_changed();
+    }
+
     auto pos = get_output_position();
     apply_surface_damage(pos.x, pos.y);
 
+    /* shm buffers are released right after this, so this is our only
+     * chance to copy them */
+    if (output && output->render->uses_software_renderer())
+    {
+        if (!pixels)
+            pixels = std::unique_ptr<wf_surface_pixels>(new wf_surface_pixels);
+
+        pixels->update(surface);
+    }
+
     if (output)
     {
         /* we schedule redraw, because the surface might expect
@@ -389,7 +425,7 @@ void wayfire_surface_t::_wlr_render_box(const wlr_fb_attribs& fb, int x, int y,
         return;
 
     wlr_box geometry {x, y, surface->current.width, surface->current.height};
-    geometry = get_output_box_from_box(geometry, output->handle->scale);
+    geometry = get_output_box_from_box(geometry, output->handle->scale * fb.zoom);
 
     float projection[9];
     wlr_matrix_projection(projection, fb.width, fb.height, fb.transform);
@@ -452,6 +488,7 @@ void wayfire_surface_t::render_fb(pixman_region32_t *damage, wf_framebuffer fb)
     attribs.width = output->handle->width;
     attribs.height = output->handle->height;
     attribs.transform = output->handle->transform;
+    attribs.zoom = fb.zoom;
 
     render_pixman(attribs, obox.x - fb.geometry.x, obox.y - fb.geometry.y, damage);
 }
@@ -82,6 +82,35 @@ wf_2D_view::wf_2D_view(wayfire_view view)
     this->view = view;
 }
 
+void wf_2D_view::set_angle(float angle)
+{
+    if (this->angle == angle)
+        return;
+
+    this->angle = angle;
+    dirty = true;
+}
+
+void wf_2D_view::set_scale(float scale_x, float scale_y)
+{
+    if (this->scale_x == scale_x && this->scale_y == scale_y)
+        return;
+
+    this->scale_x = scale_x;
+    this->scale_y = scale_y;
+    dirty = true;
+}
+
+void wf_2D_view::set_translation(float translation_x, float translation_y)
+{
+    if (this->translation_x == translation_x && this->translation_y == translation_y)
+        return;
+
+    this->translation_x = translation_x;
+    this->translation_y = translation_y;
+    dirty = true;
+}
+
 static void rotate_xy(float& x, float& y, float angle)
 {
     auto v = glm::vec4{x, y, 0, 1};
@@ -160,12 +189,52 @@ wf_3D_view::wf_3D_view(wayfire_view view)
     view_proj = proj * view_matrix;
 }
 
-/* TODO: cache total_transform, because it is often unnecessarily recomputed */
+void wf_3D_view::set_translation(const glm::mat4& translation)
+{
+    if (this->translation == translation)
+        return;
+
+    this->translation = translation;
+    total_transform_dirty = dirty = true;
+}
+
+void wf_3D_view::set_rotation(const glm::mat4& rotation)
+{
+    if (this->rotation == rotation)
+        return;
+
+    this->rotation = rotation;
+    total_transform_dirty = dirty = true;
+}
+
+void wf_3D_view::set_scaling(const glm::mat4& scaling)
+{
+    if (this->scaling == scaling)
+        return;
+
+    this->scaling = scaling;
+    total_transform_dirty = dirty = true;
+}
+
 glm::mat4 wf_3D_view::calculate_total_transform()
 {
     auto og = view->get_output()->get_relative_geometry();
-    glm::mat4 depth_scale = glm::scale(glm::mat4(1.0), {1, 1, 2.0 / std::min(og.width, og.height)});
-    return translation * view_proj * depth_scale * rotation * scaling;
+    if (og.width != output_width || og.height != output_height)
+    {
+        output_width = og.width;
+        output_height = og.height;
+        total_transform_dirty = dirty = true;
+    }
+
+    if (total_transform_dirty)
+    {
+        glm::mat4 depth_scale = glm::scale(glm::mat4(1.0),
+            {1, 1, 2.0 / std::min(og.width, og.height)});
+        total_transform = translation * view_proj * depth_scale * rotation * scaling;
+        total_transform_dirty = false;
+    }
+
+    return total_transform;
 }
 
 wf_point wf_3D_view::local_to_transformed_point(wf_geometry geometry, wf_point point)
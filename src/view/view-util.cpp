@@ -2,6 +2,7 @@
 #include "core.hpp"
 #include "output.hpp"
 #include <cstring>
+#include <unordered_map>
 
 extern "C"
 {
@@ -89,6 +90,20 @@ bool rect_intersect(wf_geometry screen, wf_geometry win)
     return true;
 }
 
+uint32_t wf_get_name_id(const std::string& name)
+{
+    static std::unordered_map<std::string, uint32_t> ids;
+
+    auto it = ids.find(name);
+    if (it != ids.end())
+        return it->second;
+
+    uint32_t id = ids.size();
+    ids[name] = id;
+
+    return id;
+}
+
 wayfire_surface_t* wf_surface_from_void(void *handle)
 {
     return static_cast<wayfire_surface_t*> (handle);
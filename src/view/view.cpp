@@ -10,6 +10,7 @@
 #include "priv-view.hpp"
 #include "xdg-shell.hpp"
 #include "xdg-shell-v6.hpp"
+#include "layout-transaction.hpp"
 
 #include <algorithm>
 #include <glm/glm.hpp>
@@ -34,12 +35,18 @@ uint32_t _last_view_id = 0;
 wayfire_view_t::wayfire_view_t()
     : wayfire_surface_t (NULL), id(_last_view_id++)
 {
+    pixman_region32_init(&transformed_damage);
+    pixman_region32_init(&pending_damage);
     set_output(core->get_active_output());
-    pixman_region32_init(&offscreen_buffer.cached_damage);
 }
 
 void wayfire_view_t::set_output(wayfire_output *wo)
 {
+    /* the pending damage is for the old output */
+    if (damage_queued && output)
+        output->render->dequeue_view_damage(this);
+    flush_damage();
+
     wayfire_surface_t::set_output(wo);
     if (decoration)
         decoration->set_output(wo);
@@ -110,6 +117,7 @@ void wayfire_view_t::move(int x, int y, bool send_signal)
     damage();
     geometry.x = x + opos.x - wm.x;
     geometry.y = y + opos.y - wm.y;
+    surface_tree_changed();
     damage();
 
     if (send_signal)
@@ -125,6 +133,7 @@ void wayfire_view_t::resize(int w, int h, bool send_signal)
     damage();
     geometry.width = w;
     geometry.height = h;
+    surface_tree_changed();
     damage();
 
     if (send_signal)
@@ -171,16 +180,44 @@ void wayfire_view_t::set_geometry(wf_geometry g)
     resize(g.width, g.height);
 }
 
-wlr_box wayfire_view_t::transform_region(const wlr_box& region)
+void wayfire_view_t::surface_tree_changed()
+{
+    /* the transformed boxes are recomputed only if the untransformed
+     * bounding box has really changed, see update_transformed_boxes() */
+    bbox_cache.untransformed_valid = false;
+}
+
+void wayfire_view_t::update_transformed_boxes()
 {
-    auto box = region;
     auto view = get_untransformed_bounding_box();
 
+    bool valid = bbox_cache.stages.size() == transforms.size() + 1 &&
+        bbox_cache.stages[0] == view;
+
+    for (auto& tr : transforms)
+        valid &= !tr->transform->dirty;
+
+    if (valid)
+        return;
+
+    flush_transformed_damage_conservative();
+    bbox_cache.stages.clear();
+    bbox_cache.stages.push_back(view);
     for (auto& tr : transforms)
     {
-        box = tr->transform->get_bounding_box(view, box);
         view = tr->transform->get_bounding_box(view, view);
+        bbox_cache.stages.push_back(view);
+        tr->transform->dirty = false;
     }
+}
+
+wlr_box wayfire_view_t::transform_region(const wlr_box& region)
+{
+    update_transformed_boxes();
+
+    auto box = region;
+    for (size_t i = 0; i < transforms.size(); i++)
+        box = transforms[i]->transform->get_bounding_box(bbox_cache.stages[i], box);
 
     return box;
 }
@@ -203,8 +240,11 @@ bool wayfire_view_t::intersects_region(const wlr_box& region)
 
 wf_geometry wayfire_view_t::get_untransformed_bounding_box()
 {
-    if (is_mapped() || !offscreen_buffer.valid())
+    if ((is_mapped() && !frozen) || !offscreen_buffer.valid())
     {
+        if (bbox_cache.untransformed_valid)
+            return bbox_cache.untransformed;
+
         auto bbox = get_output_geometry();
         int x1 = bbox.x, x2 = bbox.x + bbox.width;
         int y1 = bbox.y, y2 = bbox.y + bbox.height;
@@ -226,20 +266,24 @@ wf_geometry wayfire_view_t::get_untransformed_bounding_box()
         bbox.width = x2 - x1;
         bbox.height = y2 - y1;
 
+        bbox_cache.untransformed = bbox;
+        bbox_cache.untransformed_valid = true;
+
         return bbox;
     }
 
     return {
         offscreen_buffer.output_x,
         offscreen_buffer.output_y,
-        (int32_t)(offscreen_buffer.fb_width / output->handle->scale + 0.99),
-        (int32_t)(offscreen_buffer.fb_height / output->handle->scale + 0.99)
+        (int32_t)(offscreen_buffer.fb_width / offscreen_buffer.fb_scale + 0.99),
+        (int32_t)(offscreen_buffer.fb_height / offscreen_buffer.fb_scale + 0.99)
     };
 }
 
 wf_geometry wayfire_view_t::get_bounding_box()
 {
-    return transform_region(get_untransformed_bounding_box());
+    update_transformed_boxes();
+    return bbox_cache.stages.back();
 }
 
 void wayfire_view_t::set_maximized(bool maxim)
@@ -331,6 +375,7 @@ void wayfire_view_t::set_decoration(wayfire_surface_t *deco)
 
     decoration = deco;
     frame = dynamic_cast<wf_decorator_frame_t*> (deco);
+    surface_tree_changed();
 
     if (!deco)
         return;
@@ -366,60 +411,190 @@ wf_geometry wayfire_view_t::get_wm_geometry()
 
 void wayfire_view_t::damage(const wlr_box& box)
 {
-    if (!output)
+    offscreen_buffer.dirty = true;
+
+    /* what is on screen is the snapshot, which doesn't change */
+    if (frozen)
         return;
 
-    auto wm_geometry = get_wm_geometry();
+    damage_transformed(box);
+}
+
+void wayfire_view_t::damage(pixman_region32_t *region)
+{
+    offscreen_buffer.dirty = true;
 
-    wlr_box damage_box;
+    if (frozen || !output)
+        return;
 
+    /* transformed damage is collected box by box */
     if (transforms.size())
     {
-        auto real_box = box;
-        real_box.x -= wm_geometry.x;
-        real_box.y -= wm_geometry.y;
+        int n_rect;
+        auto rects = pixman_region32_rectangles(region, &n_rect);
+        for (int i = 0; i < n_rect; i++)
+            damage_transformed(wlr_box_from_pixman_box(rects[i]));
 
-        pixman_region32_union_rect(&offscreen_buffer.cached_damage,
-                                   &offscreen_buffer.cached_damage,
-                                   real_box.x, real_box.y,
-                                   real_box.width, real_box.height);
+        return;
+    }
 
-        /* TODO: damage only the bounding box of region */
-        damage_box = get_output_box_from_box(transform_region(box), output->handle->scale);
+    if (output->handle->scale != 1)
+    {
+        pixman_region32_t scaled;
+        pixman_region32_init(&scaled);
+        wlr_region_scale(&scaled, region, output->handle->scale);
+        pixman_region32_union(&pending_damage, &pending_damage, &scaled);
+        pixman_region32_fini(&scaled);
     } else
     {
-        damage_box = get_output_box_from_box(box, output->handle->scale);
+        pixman_region32_union(&pending_damage, &pending_damage, region);
     }
 
-    /* shell views are visible in all workspaces. That's why we must apply
-     * their damage to all workspaces as well */
+    queue_damage();
+}
 
-    if (role == WF_VIEW_ROLE_SHELL_VIEW)
+/* maximal number of boxes of a view's damage which are transformed one by one */
+static const int MAX_TRANSFORMED_DAMAGE_BOXES = 8;
+
+static bool box_contains(const wlr_box& outer, const wlr_box& inner)
+{
+    return outer.x <= inner.x && outer.y <= inner.y &&
+        inner.x + inner.width <= outer.x + outer.width &&
+        inner.y + inner.height <= outer.y + outer.height;
+}
+
+void wayfire_view_t::damage_transformed(const wlr_box& box)
+{
+    if (!output)
+        return;
+
+    if (!transforms.size())
+        return damage_output_box(get_output_box_from_box(box, output->handle->scale));
+
+    /* Transforming damage is expensive, and the many small damage boxes
+     * a transformed view gets usually cover most of it anyway. So we collect
+     * the damage during the frame and transform it when painting.
+     *
+     * Damage outside of the view (for ex. its old geometry) is applied
+     * directly, flush_transformed_damage_conservative() can't handle it */
+    update_transformed_boxes();
+    if (!box_contains(bbox_cache.stages[0], box))
     {
-        GetTuple(vw, vh, output->workspace->get_workspace_grid_size());
-        GetTuple(vx, vy, output->workspace->get_current_workspace());
-        GetTuple(sw, sh, output->get_screen_size());
+        damage_output_box(get_output_box_from_box(transform_region(box),
+                                                  output->handle->scale));
+        return;
+    }
 
-        for (int i = 0; i < vw; i++)
-        {
-            for (int j = 0; j < vh; j++)
-            {
-                int dx = (i - vx) * sw;
-                int dy = (j - vy) * sh;
+    pixman_region32_union_rect(&transformed_damage, &transformed_damage,
+                               box.x, box.y, box.width, box.height);
+    queue_damage();
+}
 
-                auto local_box = damage_box + wf_point{dx, dy};
-                output->render->damage(local_box);
-            }
+void wayfire_view_t::flush_transformed_damage()
+{
+    if (!pixman_region32_not_empty(&transformed_damage))
+        return;
+
+    /* the transforms were removed, we can't transform the damage anymore
+     * but it is still where the view was shown with them */
+    if (!output || !transforms.size())
+        return flush_transformed_damage_conservative();
+
+    /* if the transforms have changed, this damages the old bounding box */
+    update_transformed_boxes();
+    if (!pixman_region32_not_empty(&transformed_damage))
+        return;
+
+    bool transform_boxes = true;
+    for (auto& tr : transforms)
+        transform_boxes &= tr->transform->transform_damage_boxes();
+
+    int n_rect;
+    auto rects = pixman_region32_rectangles(&transformed_damage, &n_rect);
+
+    if (transform_boxes && n_rect <= MAX_TRANSFORMED_DAMAGE_BOXES)
+    {
+        for (int i = 0; i < n_rect; i++)
+        {
+            auto box = transform_region(wlr_box_from_pixman_box(rects[i]));
+            damage_output_box(get_output_box_from_box(box, output->handle->scale));
         }
     } else
     {
-        output->render->damage(damage_box);
+        auto extents = wlr_box_from_pixman_box(*pixman_region32_extents(&transformed_damage));
+        auto box = transform_region(extents);
+        damage_output_box(get_output_box_from_box(box, output->handle->scale));
+    }
+
+    pixman_region32_clear(&transformed_damage);
+}
+
+void wayfire_view_t::flush_transformed_damage_conservative()
+{
+    if (!pixman_region32_not_empty(&transformed_damage))
+        return;
+
+    /* the pending damage is inside the view, so it was transformed somewhere
+     * inside the last transformed bounding box. Add a pixel for rounding */
+    if (output && bbox_cache.stages.size())
+    {
+        auto box = bbox_cache.stages.back();
+        box.x -= 1;
+        box.y -= 1;
+        box.width += 2;
+        box.height += 2;
+
+        damage_output_box(get_output_box_from_box(box, output->handle->scale));
+    }
+
+    pixman_region32_clear(&transformed_damage);
+}
+
+void wayfire_view_t::damage_output_box(const wlr_box& damage_box)
+{
+    if (!output)
+        return;
+
+    pixman_region32_union_rect(&pending_damage, &pending_damage,
+                               damage_box.x, damage_box.y,
+                               damage_box.width, damage_box.height);
+    queue_damage();
+}
+
+void wayfire_view_t::queue_damage()
+{
+    if (damage_queued || !output)
+        return;
+
+    damage_queued = true;
+    output->render->queue_view_damage(this);
+}
+
+void wayfire_view_t::flush_damage()
+{
+    if (!damage_queued)
+        return;
+
+    /* adds to the pending damage */
+    flush_transformed_damage();
+
+    if (output && pixman_region32_not_empty(&pending_damage))
+    {
+        /* shell views are visible in all workspaces, so their damage
+         * is the same on each of them */
+        if (role == WF_VIEW_ROLE_SHELL_VIEW)
+            output->render->damage_all_workspaces(&pending_damage);
+        else
+            output->render->damage(&pending_damage);
     }
+
+    pixman_region32_clear(&pending_damage);
+    damage_queued = false;
 }
 
-void wayfire_view_t::offscreen_buffer_t::init(int w, int h)
+void wayfire_view_t::offscreen_buffer_t::init(int w, int h, std::function<bool()> evict)
 {
-    OpenGL::prepare_framebuffer_size(w, h, fbo, tex);
+    OpenGL::allocate_render_target(w, h, fbo, tex, WF_GPU_MEMORY_SNAPSHOT, evict);
     fb_width = w;
     fb_height = h;
 
@@ -442,16 +617,14 @@ void wayfire_view_t::offscreen_buffer_t::fini()
     if (!valid())
         return;
 
-    glDeleteFramebuffers(1, &fbo);
-    glDeleteTextures(1, &tex);
-
+    OpenGL::release_render_target(fbo, tex);
     fb_width = fb_height = 0;
-    fbo = tex = -1;
+    dirty = true;
 }
 
 void wayfire_view_t::take_snapshot()
 {
-    if (!get_buffer())
+    if (!get_buffer() || frozen)
         return;
 
     auto buffer_geometry = get_untransformed_bounding_box();
@@ -459,19 +632,37 @@ void wayfire_view_t::take_snapshot()
     offscreen_buffer.output_x = buffer_geometry.x;
     offscreen_buffer.output_y = buffer_geometry.y;
 
-    float scale = output->handle->scale;
-    if (int(buffer_geometry.width  * scale) != offscreen_buffer.fb_width ||
-        int(buffer_geometry.height * scale) != offscreen_buffer.fb_height ||
+    float scale = output->handle->scale * snapshot_scale;
+    int width = std::max(int(buffer_geometry.width * scale), 1);
+    int height = std::max(int(buffer_geometry.height * scale), 1);
+
+    if (width != offscreen_buffer.fb_width ||
+        height != offscreen_buffer.fb_height ||
         offscreen_buffer.fb_scale != scale)
     {
         offscreen_buffer.fini();
     }
 
+    /* nothing has changed since the last snapshot, reuse it */
+    if (offscreen_buffer.valid() && !offscreen_buffer.dirty)
+        return OpenGL::touch_render_target(offscreen_buffer.fbo);
+
     offscreen_buffer.fb_scale = scale;
     if (!offscreen_buffer.valid())
     {
-        offscreen_buffer.init(buffer_geometry.width * scale, buffer_geometry.height * scale);
-        //pixman_region32_init(&offscreen_buffer.cached_damage);
+        /* a snapshot can be taken again only while the view is mapped.
+         * Frozen views and the views which are being closed need theirs */
+        offscreen_buffer.init(width, height, [=] ()
+        {
+            if (!is_mapped() || frozen || in_paint)
+                return false;
+
+            offscreen_buffer.fini();
+            return true;
+        });
+    } else
+    {
+        OpenGL::touch_render_target(offscreen_buffer.fbo);
     }
 
     GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, offscreen_buffer.fbo));
@@ -484,11 +675,24 @@ void wayfire_view_t::take_snapshot()
     wlr_fb_attribs fb;
     fb.width = offscreen_buffer.fb_width;
     fb.height = offscreen_buffer.fb_height;
+    fb.zoom = snapshot_scale;
 
     for_each_surface([=] (wayfire_surface_t *surface, int x, int y)
     {
         surface->render_pixman(fb, x - buffer_geometry.x, y - buffer_geometry.y, NULL);
     }, true);
+
+    offscreen_buffer.dirty = false;
+}
+
+void wayfire_view_t::set_snapshot_scale(float scale)
+{
+    scale = std::max(0.01f, std::min(scale, 1.0f));
+    if (scale == snapshot_scale)
+        return;
+
+    snapshot_scale = scale;
+    damage();
 }
 
 void wayfire_view_t::render_fb(pixman_region32_t* damage, wf_framebuffer fb)
@@ -548,6 +752,31 @@ void wayfire_view_t::render_fb(pixman_region32_t* damage, wf_framebuffer fb)
         }
 
         cleanup_transforms();
+    } else if (frozen)
+    {
+        /* the snapshot, 1:1 at the position where it was taken */
+        auto box = get_untransformed_bounding_box();
+        box.x -= fb.geometry.x;
+        box.y -= fb.geometry.y;
+
+        float hw = fb.geometry.width / 2.0, hh = fb.geometry.height / 2.0;
+        gl_geometry quad = {
+            box.x - hw, hh - box.y,
+            box.x + box.width - hw, hh - box.y - box.height
+        };
+
+        auto ortho = glm::ortho(-hw, hw, -hh, hh);
+
+        fb.bind();
+        int n_rect;
+        auto rects = pixman_region32_rectangles(damage, &n_rect);
+        for (int i = 0; i < n_rect; i++)
+        {
+            auto rect = wlr_box_from_pixman_box(rects[i]);
+            fb.scissor(get_scissor_box(output, rect));
+            OpenGL::render_transformed_texture(offscreen_buffer.tex, quad, {},
+                                               fb.transform * ortho);
+        }
     } else
     {
         wayfire_surface_t::render_fb(damage, fb);
@@ -555,36 +784,75 @@ void wayfire_view_t::render_fb(pixman_region32_t* damage, wf_framebuffer fb)
     in_paint = false;
 }
 
-void wayfire_view_t::add_transformer(std::unique_ptr<wf_view_transformer_t> transformer, std::string name)
+bool wayfire_view_t::freeze()
+{
+    if (frozen)
+        return true;
+
+    if (!is_mapped() || !get_buffer())
+        return false;
+
+    take_snapshot();
+    frozen = true;
+
+    return true;
+}
+
+void wayfire_view_t::thaw()
+{
+    if (!frozen)
+        return;
+
+    /* the snapshot and the current contents */
+    damage_transformed(get_untransformed_bounding_box());
+    frozen = false;
+    surface_tree_changed();
+    damage_transformed(get_untransformed_bounding_box());
+}
+
+void wayfire_view_t::add_transformer(std::unique_ptr<wf_view_transformer_t> transformer, uint32_t name_id)
 {
     damage();
     auto tr = nonstd::make_unique<transform_t> ();
     tr->transform = std::move(transformer);
-    tr->plugin_name = name;
+    tr->name_id = name_id;
     transforms.push_back(std::move(tr));
     damage();
 }
 
+void wayfire_view_t::add_transformer(std::unique_ptr<wf_view_transformer_t> transformer, std::string name)
+{
+    add_transformer(std::move(transformer), wf_get_name_id(name));
+}
+
 void wayfire_view_t::add_transformer(std::unique_ptr<wf_view_transformer_t> transformer)
 {
 
     add_transformer(std::move(transformer), "");
 }
 
-nonstd::observer_ptr<wf_view_transformer_t> wayfire_view_t::get_transformer(std::string name)
+nonstd::observer_ptr<wf_view_transformer_t> wayfire_view_t::get_transformer(uint32_t name_id)
 {
     for (auto& tr : transforms)
     {
-        if (tr->plugin_name == name)
+        if (tr->name_id == name_id)
             return nonstd::make_observer(tr->transform.get());
     }
 
     return nullptr;
 }
 
+nonstd::observer_ptr<wf_view_transformer_t> wayfire_view_t::get_transformer(std::string name)
+{
+    return get_transformer(wf_get_name_id(name));
+}
+
 void wayfire_view_t::_pop_transformer(nonstd::observer_ptr<transform_t> transformer)
 {
     damage();
+    /* the damage above is for the transformed view, apply it while we
+     * still know where that is */
+    flush_transformed_damage_conservative();
 
     auto it = transforms.begin();
     while(it != transforms.end())
@@ -614,11 +882,11 @@ void wayfire_view_t::pop_transformer(nonstd::observer_ptr<wf_view_transformer_t>
         cleanup_transforms();
 }
 
-void wayfire_view_t::pop_transformer(std::string name)
+void wayfire_view_t::pop_transformer(uint32_t name_id)
 {
     for(auto& tr : transforms)
     {
-        if (tr->plugin_name == name)
+        if (tr->name_id == name_id)
             tr->to_remove = 1;
     }
 
@@ -626,6 +894,11 @@ void wayfire_view_t::pop_transformer(std::string name)
         cleanup_transforms();
 }
 
+void wayfire_view_t::pop_transformer(std::string name)
+{
+    pop_transformer(wf_get_name_id(name));
+}
+
 void wayfire_view_t::cleanup_transforms()
 {
     std::vector<nonstd::observer_ptr<transform_t>> to_remove;
@@ -644,6 +917,25 @@ bool wayfire_view_t::has_transformer()
     return transforms.size();
 }
 
+wf_custom_view_data *wayfire_view_t::get_data(uint32_t id)
+{
+    return id < custom_data.size() ? custom_data[id].get() : nullptr;
+}
+
+void wayfire_view_t::store_data(uint32_t id, std::unique_ptr<wf_custom_view_data> data)
+{
+    if (id >= custom_data.size())
+        custom_data.resize(id + 1);
+
+    custom_data[id] = std::move(data);
+}
+
+void wayfire_view_t::erase_data(uint32_t id)
+{
+    if (id < custom_data.size())
+        custom_data[id].reset();
+}
+
 void emit_view_map(wayfire_view view)
 {
     /* TODO: consider not emitting a create-view for special surfaces */
@@ -721,6 +1013,9 @@ void wayfire_view_t::unmap()
         c->set_toplevel_parent(nullptr);
 
     log_info("unmap %s %s %p", get_title().c_str(), get_app_id().c_str(), this);
+    if (frozen)
+        wf_layout_transaction_view_unmapped(this);
+
     if (output)
         emit_view_unmap(self());
 
@@ -796,6 +1091,9 @@ void wayfire_view_t::commit()
             frame->notify_view_resized(get_wm_geometry());
     }
 
+    if (frozen)
+        wf_layout_transaction_view_committed(this);
+
     /* clear the resize edges.
      * This is must be done here because if the user(or plugin) resizes too fast,
      * the shell client might still haven't configured the surface, * and in this
@@ -809,6 +1107,11 @@ void wayfire_view_t::damage()
     damage(get_untransformed_bounding_box());
 }
 
+void wayfire_view_t::damage_bounding_box()
+{
+    damage_transformed(get_untransformed_bounding_box());
+}
+
 void wayfire_view_t::destruct()
 {
     set_decoration(nullptr);
@@ -847,7 +1150,22 @@ void wayfire_view_t::set_toplevel_parent(wayfire_view parent)
 
 wayfire_view_t::~wayfire_view_t()
 {
-    pixman_region32_fini(&offscreen_buffer.cached_damage);
+    flush_transformed_damage_conservative();
+    if (damage_queued && output)
+        output->render->dequeue_view_damage(this);
+    flush_damage();
+
+    /* the snapshot is registered with an evict callback which refers to
+     * us, it must not outlive the view */
+    if (output)
+        OpenGL::bind_context(output->render->ctx);
+
+    offscreen_buffer.fini();
+    for (auto& tr : transforms)
+        tr->fb.release();
+
+    pixman_region32_fini(&transformed_damage);
+    pixman_region32_fini(&pending_damage);
 }
 
 void emit_title_changed(wayfire_view view)
@@ -477,6 +477,7 @@ void wayfire_unmanaged_xwayland_view::move(int x, int y, bool s)
     damage();
     geometry.x = x;
     geometry.y = y;
+    surface_tree_changed();
     send_configure();
 }
 
@@ -485,6 +486,7 @@ void wayfire_unmanaged_xwayland_view::resize(int w, int h, bool s)
     damage();
     geometry.width = w;
     geometry.height = h;
+    surface_tree_changed();
     send_configure();
 }
 
@@ -493,6 +495,7 @@ void wayfire_unmanaged_xwayland_view::set_geometry(wf_geometry g)
 {
     damage();
     geometry = g;
+    surface_tree_changed();
     send_configure();
 }
 